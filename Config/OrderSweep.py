@@ -0,0 +1,68 @@
+'''
+Regenerate the orderTable in Lib/src/STKFMM.cpp used by stkfmm::createFMM().
+
+Runs TestFMM.X with verification for each leaf size, then prints for each
+multipole order the largest relative L2 error over kernels and components,
+and the leaf size with the shortest tree + run time.
+
+Usage, from the build folder:
+    python3 ../Config/OrderSweep.py ./Test/TestFMM.X --config ../Config/Verify.toml
+'''
+
+import argparse
+import json
+import subprocess
+
+parser = argparse.ArgumentParser()
+parser.add_argument("testfmm", help="path to TestFMM.X")
+parser.add_argument("--config", default="Verify.toml",
+                    help="TestFMM.X config file, must enable verify")
+parser.add_argument("--max", type=int, nargs='+',
+                    default=[500, 1000, 1500, 2000, 3000, 4000],
+                    help="leaf sizes to sweep")
+parser.add_argument("--maxOrder", type=int, default=16,
+                    help="largest multipole order to sweep")
+parser.add_argument("--kernel", type=int, default=0,
+                    help="kernel combination, 0 for all")
+parser.add_argument("--float", action='store_true',
+                    help="sweep the single precision FMM")
+parser.add_argument("--mpirun", default="",
+                    help="launcher prefix, e.g. 'mpirun -n 4'")
+args = parser.parse_args()
+
+# order -> (error, time) for each leaf size
+sweep = dict()
+for maxPts in args.max:
+    cmd = args.mpirun.split() + [args.testfmm, "--config", args.config,
+                                 "--verify", "--no-convergence",
+                                 "-M", str(args.maxOrder + 2),
+                                 "-K", str(args.kernel),
+                                 "--max", str(maxPts)]
+    if args.float:
+        cmd.append("--float")
+    print(" ".join(cmd))
+    subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL)
+
+    with open("TestLog.json") as f:
+        logs = json.load(f)
+
+    for record in logs:
+        order = record["multOrder"]
+        error = max(e["errorL2"] for e in record["errorVerify"])
+        time = record["treeTime"] + record["runTime"]
+        point = sweep.setdefault(order, dict()).setdefault(maxPts, [0, 0])
+        point[0] = max(point[0], error)
+        point[1] += time
+
+print("order  error     maxPts  time")
+rows = []
+for order in sorted(sweep.keys()):
+    maxPts, (error, time) = min(sweep[order].items(), key=lambda k: k[1][1])
+    # the leaf size barely changes the error, report the worst one
+    error = max(v[0] for v in sweep[order].values())
+    print("{:5d}  {:.2e}  {:6d}  {:.3f}".format(order, error, maxPts, time))
+    rows.append("{{{}, {:.0e}, {}}}".format(order, error, maxPts))
+
+print("static const std::vector<OrderData> orderTable = {")
+print("    " + ", ".join(rows) + ",")
+print("};")
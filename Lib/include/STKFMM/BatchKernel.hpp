@@ -0,0 +1,327 @@
+/**
+ * @file BatchKernel.hpp
+ * @brief kernels evaluating several value sets on the same points at once
+ *
+ * A batched kernel stacks N value sets of one kernel into one density, set b in components
+ * [b * kdim, (b + 1) * kdim) of every point. Its translation operators are block diagonal,
+ * so each box translates all N sets with one matrix product, and the P2P micro kernels
+ * compute the geometry of a source-target pair once for all N sets.
+ * Stk3DFMM evaluates them in evaluateFMMBatch().
+ */
+#ifndef BATCHKERNEL_HPP_
+#define BATCHKERNEL_HPP_
+
+#include "LaplaceLayerKernel.hpp"
+
+namespace pvfmm {
+
+/**********************************************************
+ *                                                        *
+ *   Stokeslet velocity, N sets, source: 3N, target: 3N   *
+ *                                                        *
+ **********************************************************/
+template <int N>
+struct stokes_vel_batch : public GenericKernel<stokes_vel_batch<N>> {
+    static const int FLOPS = 20 * N;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[3 * N], const VecType (&r)[3], const VecType (&f)[3 * N],
+                         const void *ctx_ptr) {
+        VecType r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+        VecType rinv = sctl::approx_rsqrt<digits>(r2, r2 > VecType::Zero());
+        VecType rinv3 = rinv * rinv * rinv;
+
+        for (int b = 0; b < N; b++) {
+            const VecType *fb = f + 3 * b;
+            VecType fdotr = fb[0] * r[0] + fb[1] * r[1] + fb[2] * r[2];
+            u[3 * b + 0] += (r2 * fb[0] + r[0] * fdotr) * rinv3;
+            u[3 * b + 1] += (r2 * fb[1] + r[1] * fdotr) * rinv3;
+            u[3 * b + 2] += (r2 * fb[2] + r[2] * fdotr) * rinv3;
+        }
+    }
+};
+
+/**********************************************************
+ *                                                        *
+ *   RPY velocity, N sets, source: 4N, target: 3N         *
+ *           fx,fy,fz,a -> ux,uy,uz                       *
+ **********************************************************/
+template <int N>
+struct rpy_u_batch : public GenericKernel<rpy_u_batch<N>> {
+    static const int FLOPS = 20 * N;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[3 * N], const VecType (&r)[3], const VecType (&f)[4 * N],
+                         const void *ctx_ptr) {
+        VecType r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+        VecType rinv = sctl::approx_rsqrt<digits>(r2, r2 > VecType::Zero());
+        VecType rinv3 = rinv * rinv * rinv;
+        VecType rinv5 = rinv3 * rinv * rinv;
+        const VecType three = (typename VecType::ScalarType)(3.0);
+        const VecType one_over_three = (typename VecType::ScalarType)(0.3333333333333);
+
+        for (int b = 0; b < N; b++) {
+            const VecType *fb = f + 4 * b;
+            VecType fdotr = fb[0] * r[0] + fb[1] * r[1] + fb[2] * r[2];
+            VecType three_fdotr_rinv5 = three * fdotr * rinv5;
+            VecType a2_over_three = one_over_three * fb[3] * fb[3];
+            for (int k = 0; k < 3; k++) {
+                u[3 * b + k] +=
+                    (r2 * fb[k] + r[k] * fdotr) * rinv3 + a2_over_three * (fb[k] * rinv3 - three_fdotr_rinv5 * r[k]);
+            }
+        }
+    }
+};
+
+/**********************************************************
+ *                                                        *
+ * Stokes Vel,lapVel, N sets, source: 3N, target: 6N      *
+ *       fx,fy,fz -> ux,uy,uz,lapux,lapuy,lapuz           *
+ **********************************************************/
+template <int N>
+struct stk_ulapu_batch : public GenericKernel<stk_ulapu_batch<N>> {
+    static const int FLOPS = 20 * N;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[6 * N], const VecType (&r)[3], const VecType (&f)[3 * N],
+                         const void *ctx_ptr) {
+        VecType r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+        VecType rinv = sctl::approx_rsqrt<digits>(r2, r2 > VecType::Zero());
+        VecType rinv3 = rinv * rinv * rinv;
+        VecType rinv5 = rinv3 * rinv * rinv;
+        const VecType two = (typename VecType::ScalarType)(2.0);
+        const VecType three = (typename VecType::ScalarType)(3.0);
+
+        for (int b = 0; b < N; b++) {
+            const VecType *fb = f + 3 * b;
+            VecType fdotr = fb[0] * r[0] + fb[1] * r[1] + fb[2] * r[2];
+            VecType fdotr_rinv3 = fdotr * rinv3;
+            VecType three_fdotr_rinv5 = three * fdotr * rinv5;
+            for (int k = 0; k < 3; k++) {
+                u[6 * b + k] += fb[k] * rinv + r[k] * fdotr_rinv3;
+                u[6 * b + 3 + k] += two * (fb[k] * rinv3 - three_fdotr_rinv5 * r[k]);
+            }
+        }
+    }
+};
+
+/**********************************************************
+ *                                                        *
+ * RPY Vel,lapVel, N sets, source: 4N, target: 6N         *
+ *       fx,fy,fz,a -> ux,uy,uz,lapux,lapuy,lapuz         *
+ **********************************************************/
+template <int N>
+struct rpy_ulapu_batch : public GenericKernel<rpy_ulapu_batch<N>> {
+    static const int FLOPS = 20 * N;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[6 * N], const VecType (&r)[3], const VecType (&f)[4 * N],
+                         const void *ctx_ptr) {
+        VecType r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+        VecType rinv = sctl::approx_rsqrt<digits>(r2, r2 > VecType::Zero());
+        VecType rinv3 = rinv * rinv * rinv;
+        VecType rinv5 = rinv3 * rinv * rinv;
+        const VecType two = (typename VecType::ScalarType)(2.0);
+        const VecType three = (typename VecType::ScalarType)(3.0);
+        const VecType one_over_three = (typename VecType::ScalarType)(0.3333333333333);
+
+        for (int b = 0; b < N; b++) {
+            const VecType *fb = f + 4 * b;
+            VecType fdotr = fb[0] * r[0] + fb[1] * r[1] + fb[2] * r[2];
+            VecType fdotr_rinv3 = fdotr * rinv3;
+            VecType three_fdotr_rinv5 = three * fdotr * rinv5;
+            VecType a2_over_three = one_over_three * fb[3] * fb[3];
+            for (int k = 0; k < 3; k++) {
+                VecType c = fb[k] * rinv3 - three_fdotr_rinv5 * r[k];
+                u[6 * b + k] += fb[k] * rinv + r[k] * fdotr_rinv3 + a2_over_three * c;
+                u[6 * b + 3 + k] += two * c;
+            }
+        }
+    }
+};
+
+/**********************************************************
+ *                                                        *
+ *   Laplace potential, N sets, source: N, target: N      *
+ *                                                        *
+ **********************************************************/
+template <int N>
+struct laplace_p_batch : public GenericKernel<laplace_p_batch<N>> {
+    static const int FLOPS = 20 * N;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (4.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[N], const VecType (&r)[3], const VecType (&f)[N], const void *ctx_ptr) {
+        VecType r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+        VecType rinv = sctl::approx_rsqrt<digits>(r2, r2 > VecType::Zero());
+
+        for (int b = 0; b < N; b++) {
+            u[b] += f[b] * rinv;
+        }
+    }
+};
+
+/**********************************************************
+ *                                                        *
+ *   Laplace potential and gradient, source: N, target: 4N*
+ *                                                        *
+ **********************************************************/
+template <int N>
+struct laplace_pgrad_batch : public GenericKernel<laplace_pgrad_batch<N>> {
+    static const int FLOPS = 20 * N;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (4.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[4 * N], const VecType (&r)[3], const VecType (&f)[N], const void *ctx_ptr) {
+        VecType r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+        VecType rinv = sctl::approx_rsqrt<digits>(r2, r2 > VecType::Zero());
+        VecType rinv3 = rinv * rinv * rinv;
+
+        for (int b = 0; b < N; b++) {
+            VecType sv = f[b] * rinv3;
+            u[4 * b + 0] += sv * r2;
+            u[4 * b + 1] -= sv * r[0];
+            u[4 * b + 2] -= sv * r[1];
+            u[4 * b + 3] -= sv * r[2];
+        }
+    }
+};
+
+/**********************************************************
+ *                                                        *
+ *   Laplace dipole potential, source: 3N, target: N      *
+ *                                                        *
+ **********************************************************/
+template <int N>
+struct laplace_dipolep_batch : public GenericKernel<laplace_dipolep_batch<N>> {
+    static const int FLOPS = 20 * N;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (4.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[N], const VecType (&r)[3], const VecType (&f)[3 * N], const void *ctx_ptr) {
+        VecType r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+        VecType rinv = sctl::approx_rsqrt<digits>(r2, r2 > VecType::Zero());
+        VecType rinv3 = rinv * rinv * rinv;
+
+        for (int b = 0; b < N; b++) {
+            const VecType *fb = f + 3 * b;
+            u[b] += rinv3 * (fb[0] * r[0] + fb[1] * r[1] + fb[2] * r[2]);
+        }
+    }
+};
+
+/**********************************************************
+ *                                                        *
+ *   Laplace dipole potential and gradient, 3N -> 4N      *
+ *                                                        *
+ **********************************************************/
+template <int N>
+struct laplace_dipolepgrad_batch : public GenericKernel<laplace_dipolepgrad_batch<N>> {
+    static const int FLOPS = 20 * N;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (4.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[4 * N], const VecType (&r)[3], const VecType (&f)[3 * N],
+                         const void *ctx_ptr) {
+        VecType r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+        VecType rinv = sctl::approx_rsqrt<digits>(r2, r2 > VecType::Zero());
+        VecType rinv2 = rinv * rinv;
+        VecType rinv3 = rinv2 * rinv;
+        VecType rinv5 = rinv3 * rinv2;
+        const VecType three = (typename VecType::ScalarType)(3.0);
+
+        for (int b = 0; b < N; b++) {
+            const VecType *fb = f + 3 * b;
+            VecType rdotn = fb[0] * r[0] + fb[1] * r[1] + fb[2] * r[2];
+            u[4 * b + 0] += rdotn * rinv3;
+            u[4 * b + 1] += (fb[0] * r2 - three * rdotn * r[0]) * rinv5;
+            u[4 * b + 2] += (fb[1] * r2 - three * rdotn * r[1]) * rinv5;
+            u[4 * b + 3] += (fb[2] * r2 - three * rdotn * r[2]) * rinv5;
+        }
+    }
+};
+
+/**
+ * @brief batched kernels, nRHS value sets stacked in each point
+ * the far-field names are listed in the m2lBlockTable of FMMData.cpp
+ *
+ * @tparam T float or double
+ */
+template <class T>
+struct BatchKernel {
+    static const int nRHS = 4; ///< value sets per batch
+
+    inline static const Kernel<T> &StokesVel(); ///< Stokes, 3 nRHS -> 3 nRHS
+    inline static const Kernel<T> &RPYULapU();  ///< RPY, 4 nRHS -> 6 nRHS
+    inline static const Kernel<T> &LapPGrad();  ///< LapPGrad, SL nRHS + DL 3 nRHS -> 4 nRHS
+};
+
+template <class T>
+inline const Kernel<T> &BatchKernel<T>::StokesVel() {
+    static Kernel<T> ker = BuildKernel<T, stokes_vel_batch<nRHS>::template Eval<T>>(
+        "stokes_vel_x4", 3, std::pair<int, int>(3 * nRHS, 3 * nRHS));
+    return ker;
+}
+
+template <class T>
+inline const Kernel<T> &BatchKernel<T>::RPYULapU() {
+    // the far field is the batched Stokeslet, as stokes_vel is for RPY
+    const Kernel<T> *g_ker = &StokesVel();
+    static Kernel<T> gr_ker = BuildKernel<T, rpy_u_batch<nRHS>::template Eval<T>>(
+        "rpy_u_x4", 3, std::pair<int, int>(4 * nRHS, 3 * nRHS));
+    static Kernel<T> glapg_ker = BuildKernel<T, stk_ulapu_batch<nRHS>::template Eval<T>>(
+        "stk_ulapu_x4", 3, std::pair<int, int>(3 * nRHS, 6 * nRHS));
+
+    static Kernel<T> grlapgr_ker = BuildKernel<T, rpy_ulapu_batch<nRHS>::template Eval<T>>(
+        "rpy_ulapu_x4", 3, std::pair<int, int>(4 * nRHS, 6 * nRHS),
+        &gr_ker,    // k_s2m
+        &gr_ker,    // k_s2l
+        NULL,       // k_s2t
+        g_ker,      // k_m2m
+        g_ker,      // k_m2l
+        &glapg_ker, // k_m2t
+        g_ker,      // k_l2l
+        &glapg_ker, // k_l2t
+        NULL);
+    return grlapgr_ker;
+}
+
+template <class T>
+inline const Kernel<T> &BatchKernel<T>::LapPGrad() {
+    static Kernel<T> lap_pker =
+        BuildKernel<T, laplace_p_batch<nRHS>::template Eval<T>, laplace_dipolep_batch<nRHS>::template Eval<T>>(
+            "laplace_x4", 3, std::pair<int, int>(nRHS, nRHS));
+    lap_pker.surf_dim = 3 * nRHS;
+
+    static Kernel<T> lap_pgker =
+        BuildKernel<T, laplace_pgrad_batch<nRHS>::template Eval<T>,
+                    laplace_dipolepgrad_batch<nRHS>::template Eval<T>>(
+            "laplace_PGrad_x4", 3, std::pair<int, int>(nRHS, 4 * nRHS), &lap_pker, &lap_pker, NULL, &lap_pker,
+            &lap_pker, NULL, &lap_pker, NULL);
+    lap_pgker.surf_dim = 3 * nRHS;
+    return lap_pgker;
+}
+
+} // namespace pvfmm
+
+#endif
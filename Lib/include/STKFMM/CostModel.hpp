@@ -0,0 +1,93 @@
+#ifndef STKFMM_COSTMODEL_HPP_
+#define STKFMM_COSTMODEL_HPP_
+
+#include <algorithm>
+#include <vector>
+
+#include <mpi.h>
+
+namespace stkfmm {
+
+namespace impl {
+
+/**
+ * @brief estimated FMM work of each point, from point densities on a uniform grid over [0,1)^3
+ * (1) a target pays for its near-field pairs, which pvfmm evaluates on the rank owning the target
+ * (2) every point pays for S2M or L2T on its own, and for a share of the M2L work of its leaf
+ * The estimate counts pair interactions weighted by the kernel dimensions.
+ * Usage: count() all point sets, reduce(), then weight()
+ */
+class CostModel {
+  public:
+    enum PointType { SL = 0, DL = 1, TRG = 2 };
+
+    /**
+     * @brief Construct a new CostModel object
+     *
+     * @param kdimSL_ SL source kernel dimension
+     * @param kdimDL_ DL source kernel dimension
+     * @param kdimTrg_ target kernel dimension
+     * @param kdimM2L_ M2L kernel dimension
+     * @param multOrder_ multipole order
+     * @param maxPts_ max number of points in a leaf box
+     */
+    CostModel(int kdimSL_, int kdimDL_, int kdimTrg_, int kdimM2L_, int multOrder_, int maxPts_);
+
+    /**
+     * @brief count points of one type on this rank
+     *
+     * @tparam Real float or double
+     * @param npts number of points
+     * @param coord coordinates in [0,1)^3
+     * @param type
+     */
+    template <class Real>
+    void count(const int npts, const Real *coord, const PointType type) {
+        for (int i = 0; i < npts; i++) {
+            cellCount[3 * cellIndex(coord + 3 * i) + type] += 1;
+        }
+    }
+
+    /**
+     * @brief sum the counts over comm and compute the weight of each cell, collective
+     *
+     * @param comm
+     */
+    void reduce(MPI_Comm comm);
+
+    /**
+     * @brief estimated work of a point, after reduce()
+     *
+     * @tparam Real float or double
+     * @param coord coordinate in [0,1)^3
+     * @param type
+     * @return double
+     */
+    template <class Real>
+    double weight(const Real *coord, const PointType type) const {
+        return cellWeight[3 * cellIndex(coord) + type];
+    }
+
+  private:
+    static constexpr int nGrid = 32; ///< cells per dimension
+
+    double kdim[3];                  ///< kernel dimension of SL, DL, TRG
+    int kdimM2L;                     ///< M2L kernel dimension
+    int nEquiv;                      ///< number of equivalent points
+    int maxPts;                      ///< max number of points in a leaf box
+    std::vector<double> cellCount;   ///< SL, DL, TRG points per cell
+    std::vector<double> cellWeight;  ///< SL, DL, TRG weight per cell
+
+    template <class Real>
+    static int cellIndex(const Real *coord) {
+        int idx[3];
+        for (int k = 0; k < 3; k++) {
+            idx[k] = std::min(std::max(static_cast<int>(coord[k] * nGrid), 0), nGrid - 1);
+        }
+        return (idx[2] * nGrid + idx[1]) * nGrid + idx[0];
+    }
+};
+
+} // namespace impl
+} // namespace stkfmm
+#endif
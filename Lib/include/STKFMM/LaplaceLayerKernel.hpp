@@ -33,6 +33,7 @@ template <class T>
  */
 struct LaplaceLayerKernel {
     // inline static const Kernel<T> &Grad();    ///< Laplace Grad Kernel, for test only
+    inline static const Kernel<T> &P();          ///< Laplace P Kernel, far field of PGrad and PGradGrad
     inline static const Kernel<T> &PGrad();      ///< Laplace PGrad Kernel
     inline static const Kernel<T> &PGradGrad();  ///< Laplace PGradGrad
     inline static const Kernel<T> &QPGradGrad(); ///< Laplace Quadruple PGradGrad, no double layer
@@ -312,14 +313,21 @@ struct laplace_quadpgradgrad : public GenericKernel<laplace_quadpgradgrad> {
 };
 
 template <class T>
-const Kernel<T> &LaplaceLayerKernel<T>::PGrad() {
+inline const Kernel<T> &LaplaceLayerKernel<T>::P() {
     static Kernel<T> lap_pker =
         BuildKernel<T, laplace_p::Eval<T>, laplace_dipolep::Eval<T>>("laplace", 3, std::pair<int, int>(1, 1));
     lap_pker.surf_dim = 3;
+    return lap_pker;
+}
+
+template <class T>
+const Kernel<T> &LaplaceLayerKernel<T>::PGrad() {
+    // share the far field kernel with PGradGrad
+    const Kernel<T> *lap_pker = &P();
 
     static Kernel<T> lap_pgker = BuildKernel<T, laplace_pgrad::Eval<T>, laplace_dipolepgrad::Eval<T>>(
-        "laplace_PGrad", 3, std::pair<int, int>(1, 4), &lap_pker, &lap_pker, NULL, &lap_pker, &lap_pker, NULL,
-        &lap_pker, NULL);
+        "laplace_PGrad", 3, std::pair<int, int>(1, 4), lap_pker, lap_pker, NULL, lap_pker, lap_pker, NULL, lap_pker,
+        NULL);
     lap_pgker.surf_dim = 3;
 
     return lap_pgker;
@@ -327,14 +335,12 @@ const Kernel<T> &LaplaceLayerKernel<T>::PGrad() {
 
 template <class T>
 inline const Kernel<T> &LaplaceLayerKernel<T>::PGradGrad() {
-
-    static Kernel<T> lap_pker =
-        BuildKernel<T, laplace_p::Eval<T>, laplace_dipolep::Eval<T>>("laplace", 3, std::pair<int, int>(1, 1));
-    lap_pker.surf_dim = 3;
+    // share the far field kernel with PGrad
+    const Kernel<T> *lap_pker = &P();
 
     static Kernel<T> lap_pgker = BuildKernel<T, laplace_pgradgrad::Eval<T>, laplace_dipolepgradgrad::Eval<T>>(
-        "laplace_PGradGrad", 3, std::pair<int, int>(1, 10), &lap_pker, &lap_pker, NULL, &lap_pker, &lap_pker, NULL,
-        &lap_pker, NULL);
+        "laplace_PGradGrad", 3, std::pair<int, int>(1, 10), lap_pker, lap_pker, NULL, lap_pker, lap_pker, NULL,
+        lap_pker, NULL);
     lap_pgker.surf_dim = 3;
 
     return lap_pgker;
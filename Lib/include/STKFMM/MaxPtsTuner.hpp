@@ -0,0 +1,51 @@
+#ifndef STKFMM_MAXPTSTUNER_HPP_
+#define STKFMM_MAXPTSTUNER_HPP_
+
+#include <string>
+
+namespace stkfmm {
+
+namespace impl {
+
+class FMMData;
+
+/**
+ * @brief choose maxPts of an FMMData constructed with maxPts = 0
+ * (1) the optimum for (kernel, order, precision, periodicity, OpenMP threads) is looked up in the profile file
+ * (2) on a miss, setupTree() + evaluateFMM() are timed on random points for a few maxPts values,
+ *     and the fastest is appended to the profile file
+ * The profile file is $STKFMM_PROFILE, or maxPts.txt in the translation cache directory if STKFMM_CACHE_DIR is set.
+ * The optimum depends on the machine, so use one profile file per machine type.
+ * Remark: collective over the FMMData communicator
+ */
+class MaxPtsTuner {
+  public:
+    /**
+     * @brief find or measure the optimal maxPts
+     *
+     * @param fmm an FMMData without a tree, the tree is deleted afterwards
+     * @return int
+     */
+    static int tune(FMMData &fmm);
+
+  private:
+    /**
+     * @brief path of the profile file, collective
+     *
+     * @param fmm
+     * @return empty if the profile is not persisted
+     */
+    static std::string profileFile(const FMMData &fmm);
+
+    /**
+     * @brief time setupTree() + evaluateFMM() for each candidate maxPts
+     *
+     * @param fmm
+     * @return the fastest candidate, the same on all ranks
+     */
+    static int measure(FMMData &fmm);
+};
+
+} // namespace impl
+} // namespace stkfmm
+#endif
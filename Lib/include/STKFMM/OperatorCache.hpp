@@ -0,0 +1,92 @@
+#ifndef STKFMM_OPERATORCACHE_HPP_
+#define STKFMM_OPERATORCACHE_HPP_
+
+#include "OperatorFile.hpp"
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <mpi.h>
+
+namespace stkfmm {
+
+namespace impl {
+
+/**
+ * @brief process-wide, reference-counted cache of periodic operators
+ * (1) FMMData objects asking for the same operator in one process share one copy
+ * (2) ranks on the same node share one copy through an MPI-3 shared memory window
+ * (3) only rank 0 touches the file system, and broadcasts to one leader rank per node.
+ *     Set environment variable STKFMM_OPERATOR_READER=node to read once per node instead.
+ *     Then a binary operator file is mmap()ed by every rank on the node and shared through the page cache,
+ *     without a copy. Only text files and operators generated in memory go through the window
+ * Entries are kept until release(), which frees the unused ones at a collective point chosen by the user.
+ * Remark: get() is collective over comm, and all ranks must request operators in the same order on one comm.
+ * FMM objects on different communicators may call get() concurrently. No lock is held across MPI calls,
+ * the ranks of comm agree on hit or miss, and concurrent misses of one name each load their own copy.
+ */
+class OperatorCache {
+  public:
+    using Loader = std::function<std::shared_ptr<const OperatorMatrix>()>;
+    using Prepare = std::function<bool()>;
+
+    /**
+     * @brief get an operator from the cache, or load and distribute it on a miss
+     *
+     * @param name unique key, usually operatorName(type, kernel, pbc, order)
+     * @param comm communicator of the FMM object
+     * @param loader called on the reading rank(s) on cache miss
+     * @param prepare called on all ranks on cache miss before loader, may be collective over comm and call get().
+     *        Returns true on all ranks if only comm rank 0 can load the operator, e.g. it is generated in memory,
+     *        then rank 0 reads even with STKFMM_OPERATOR_READER=node
+     * @return std::shared_ptr<const OperatorMatrix>
+     */
+    static std::shared_ptr<const OperatorMatrix> get(const std::string &name, MPI_Comm comm, const Loader &loader,
+                                                     const Prepare &prepare = Prepare());
+
+    /**
+     * @brief free the entries no FMMData holds any more, on all ranks
+     * Freeing a shared window is collective, so entries are never freed when the last holder is destroyed.
+     * Collective over MPI_COMM_WORLD, called by STKFMM::releaseOperators()
+     */
+    static void release();
+
+    /**
+     * @brief bytes of all cached entries, each is one copy per node shared by the ranks on it
+     *
+     * @return std::size_t
+     */
+    static std::size_t bytes();
+
+    /**
+     * @brief directory for pvfmm translation operators (M2M, M2L, L2L, ...)
+     * $STKFMM_CACHE_DIR/<hash of kernels, pvfmm and compiler>, created if missing. collective over comm
+     *
+     * @param comm communicator of the FMM object
+     * @return empty if STKFMM_CACHE_DIR is not set
+     */
+    static std::string translationCacheDir(MPI_Comm comm);
+
+  private:
+    /**
+     * @brief get STKFMM_OPERATOR_READER environment variable
+     *
+     * @return true if each node leader reads the file, false if only rank 0 reads
+     */
+    static bool readOnEveryNode();
+
+    /**
+     * @brief split comm into the ranks sharing memory, ordered by rank in comm
+     * Environment variable STKFMM_RANKS_PER_NODE=n splits each node further into groups of n ranks,
+     * to test the distribution to several nodes on one machine
+     *
+     * @param comm communicator of the FMM object
+     * @return MPI_Comm to be freed by the caller
+     */
+    static MPI_Comm splitNode(MPI_Comm comm);
+};
+
+} // namespace impl
+} // namespace stkfmm
+#endif
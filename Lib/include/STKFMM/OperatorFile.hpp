@@ -0,0 +1,305 @@
+/**
+ * @file OperatorFile.hpp
+ * @brief binary file format for precomputed periodic operators
+ *
+ * A file is a 128 byte OperatorHeader followed by rows*cols doubles in column-major order.
+ * The payload starts at a fixed offset so a mmap()ed file can be handed to pvfmm in place.
+ *
+ * This header does not depend on pvfmm so it can be shared with the M2L generators.
+ */
+#ifndef STKFMM_OPERATORFILE_HPP_
+#define STKFMM_OPERATORFILE_HPP_
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace stkfmm {
+
+constexpr char OPERATOR_MAGIC[8] = {'S', 'T', 'K', 'F', 'M', 'M', 'O', 'P'};
+constexpr std::uint32_t OPERATOR_VERSION = 1; ///< bump when the layout changes
+
+/**
+ * @brief fixed size header of a binary operator file
+ *
+ */
+struct OperatorHeader {
+    char magic[8];           ///< OPERATOR_MAGIC
+    std::uint32_t version;   ///< OPERATOR_VERSION
+    std::uint32_t pbc;       ///< periodicity, 1 = PX, 2 = PXY, 3 = PXYZ
+    std::uint32_t order;     ///< multipole order
+    std::uint32_t rows;      ///< number of rows
+    std::uint32_t cols;      ///< number of columns
+    std::uint32_t reserved;  ///< zero
+    std::uint64_t checksum;  ///< operatorChecksum() of the payload
+    char type[8];            ///< operator type, "M2C" or "M2L", null terminated
+    char kernel[32];         ///< pvfmm m2l kernel name, null terminated
+    char padding[48];        ///< zero
+};
+static_assert(sizeof(OperatorHeader) == 128, "OperatorHeader must be 128 bytes");
+
+/**
+ * @brief file name of a periodic operator, without directory and extension
+ *
+ * @param type "M2C" or "M2L"
+ * @param kernel pvfmm m2l kernel name
+ * @param pbc periodicity 1,2,3
+ * @param order multipole order
+ * @return std::string
+ */
+inline std::string operatorName(const std::string &type, const std::string &kernel, int pbc, int order) {
+    return type + "_" + kernel + "_" + std::to_string(pbc) + "D3D_p" + std::to_string(order);
+}
+
+/**
+ * @brief 64 bit FNV-1a hash over the payload, one 8-byte word per step
+ *
+ * @param data
+ * @param n number of doubles
+ * @return std::uint64_t
+ */
+inline std::uint64_t operatorChecksum(const double *data, std::size_t n) {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (std::size_t i = 0; i < n; i++) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash ^= word;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief write a column-major operator to a binary file
+ *
+ * @return true if success
+ */
+inline bool writeOperator(const std::string &file, const std::string &type, const std::string &kernel, int pbc,
+                          int order, int rows, int cols, const double *colMajor) {
+    OperatorHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, OPERATOR_MAGIC, sizeof(header.magic));
+    header.version = OPERATOR_VERSION;
+    header.pbc = pbc;
+    header.order = order;
+    header.rows = rows;
+    header.cols = cols;
+    header.checksum = operatorChecksum(colMajor, std::size_t(rows) * cols);
+    std::strncpy(header.type, type.c_str(), sizeof(header.type) - 1);
+    std::strncpy(header.kernel, kernel.c_str(), sizeof(header.kernel) - 1);
+
+    // write to a temporary file and rename, so readers never see a partial file
+    const std::string tmpFile = file + ".tmp" + std::to_string(getpid());
+    FILE *fout = fopen(tmpFile.c_str(), "wb");
+    if (fout == nullptr) {
+        std::cout << "cannot open " << tmpFile << " for writing" << std::endl;
+        return false;
+    }
+    const std::size_t n = std::size_t(rows) * cols;
+    bool success = fwrite(&header, sizeof(header), 1, fout) == 1 && fwrite(colMajor, sizeof(double), n, fout) == n;
+    success = (fclose(fout) == 0) && success;
+    if (success)
+        success = rename(tmpFile.c_str(), file.c_str()) == 0;
+    if (!success) {
+        std::cout << "error writing " << file << std::endl;
+        remove(tmpFile.c_str());
+    }
+    return success;
+}
+
+/**
+ * @brief a read-only operator matrix, either mmap()ed from a binary file or owned in memory
+ *
+ */
+class OperatorMatrix {
+  public:
+    OperatorMatrix() = default;
+    OperatorMatrix(const OperatorMatrix &) = delete;
+    OperatorMatrix &operator=(const OperatorMatrix &) = delete;
+
+    /**
+     * @brief take ownership of a column-major matrix in memory
+     *
+     */
+    OperatorMatrix(int rows_, int cols_, std::vector<double> &&colMajor)
+        : rows(rows_), cols(cols_), owned(std::move(colMajor)) {
+        ptr = owned.data();
+    }
+
+    /**
+     * @brief wrap a column-major matrix owned elsewhere, release() is called on destruction
+     *
+     */
+    OperatorMatrix(int rows_, int cols_, const double *external, std::function<void()> release_)
+        : rows(rows_), cols(cols_), ptr(external), release(std::move(release_)) {}
+
+    ~OperatorMatrix() {
+        unmap();
+        if (release)
+            release();
+    }
+
+    /**
+     * @brief map a binary operator file and validate its header
+     *
+     * @param file path to the binary file
+     * @param type expected operator type
+     * @param kernel expected kernel name
+     * @param pbc expected periodicity
+     * @param order expected multipole order
+     * @param dim expected number of rows and columns
+     * @param verifyChecksum scan the payload and compare with the stored checksum.
+     *        This touches every page, so it is off by default to keep the mapping lazy
+     * @return true if the file is mapped and valid
+     */
+    bool map(const std::string &file, const std::string &type, const std::string &kernel, int pbc, int order,
+             int dim, bool verifyChecksum = false) {
+        if (!mapFile(file))
+            return false;
+
+        const OperatorHeader &header = *static_cast<const OperatorHeader *>(mapAddr);
+        const std::size_t n = std::size_t(header.rows) * header.cols;
+        std::string error;
+        if (std::memcmp(header.magic, OPERATOR_MAGIC, sizeof(header.magic)) != 0)
+            error = "bad magic";
+        else if (header.version != OPERATOR_VERSION)
+            error = "version " + std::to_string(header.version) + " unsupported";
+        else if (std::string(header.type, strnlen(header.type, sizeof(header.type))) != type ||
+                 std::string(header.kernel, strnlen(header.kernel, sizeof(header.kernel))) != kernel ||
+                 int(header.pbc) != pbc || int(header.order) != order)
+            error = "header does not match " + operatorName(type, kernel, pbc, order);
+        else if (int(header.rows) != dim || int(header.cols) != dim)
+            error = "dimension mismatch";
+        else if (mapLen != sizeof(OperatorHeader) + n * sizeof(double))
+            error = "truncated payload";
+
+        ptr = reinterpret_cast<const double *>(static_cast<const char *>(mapAddr) + sizeof(OperatorHeader));
+        if (error.empty() && verifyChecksum && operatorChecksum(ptr, n) != header.checksum)
+            error = "checksum mismatch";
+
+        if (!error.empty()) {
+            std::cout << file << ": " << error << std::endl;
+            unmap();
+            return false;
+        }
+        rows = header.rows;
+        cols = header.cols;
+        return true;
+    }
+
+    /**
+     * @brief map a binary operator file that another process has validated with the full map()
+     * Processes mapping the same file share its pages in the page cache, so only the size is checked
+     *
+     * @param file path to the binary file
+     * @param rows_ number of rows
+     * @param cols_ number of columns
+     * @return true if the file is mapped and has the size of a rows_ x cols_ operator
+     */
+    bool map(const std::string &file, int rows_, int cols_) {
+        if (!mapFile(file))
+            return false;
+        if (mapLen != sizeof(OperatorHeader) + std::size_t(rows_) * cols_ * sizeof(double)) {
+            std::cout << file << ": dimension mismatch" << std::endl;
+            unmap();
+            return false;
+        }
+        ptr = reinterpret_cast<const double *>(static_cast<const char *>(mapAddr) + sizeof(OperatorHeader));
+        rows = rows_;
+        cols = cols_;
+        return true;
+    }
+
+    const double *data() const { return ptr; }   ///< column-major payload
+    std::size_t size() const { return std::size_t(rows) * cols; } ///< number of entries
+    int getRows() const { return rows; }         ///< number of rows
+    int getCols() const { return cols; }         ///< number of columns
+    bool isMapped() const { return mapAddr != nullptr; } ///< backed by a mmap()ed file
+    const std::string &getFile() const { return mapFileName; } ///< the mmap()ed file, empty if not mapped
+
+  private:
+    int rows = 0;
+    int cols = 0;
+    const double *ptr = nullptr;
+    std::vector<double> owned;
+    std::function<void()> release;
+    void *mapAddr = nullptr;
+    std::size_t mapLen = 0;
+    std::string mapFileName;
+
+    bool mapFile(const std::string &file) {
+        unmap();
+        int fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(OperatorHeader)) {
+            close(fd);
+            std::cout << file << " is not a valid operator file" << std::endl;
+            return false;
+        }
+        void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (addr == MAP_FAILED) {
+            std::cout << "mmap " << file << " failed" << std::endl;
+            return false;
+        }
+        mapAddr = addr;
+        mapLen = st.st_size;
+        mapFileName = file;
+        return true;
+    }
+
+    void unmap() {
+        if (mapAddr != nullptr) {
+            munmap(mapAddr, mapLen);
+            mapAddr = nullptr;
+            mapLen = 0;
+            mapFileName.clear();
+        }
+        if (owned.empty())
+            ptr = nullptr;
+    }
+};
+
+/**
+ * @brief read a square text operator written by the M2L generators, "i j value" per line in row-major order
+ *
+ * @param file
+ * @param dim number of rows and columns
+ * @param colMajor [out] matrix in column-major order
+ * @return true if success
+ */
+inline bool readTextOperator(const std::string &file, const int dim, std::vector<double> &colMajor) {
+    FILE *fin = fopen(file.c_str(), "r");
+    if (fin == nullptr)
+        return false;
+    colMajor.resize(std::size_t(dim) * dim);
+    for (int i = 0; i < dim; i++) {
+        for (int j = 0; j < dim; j++) {
+            int iread, jread;
+            double fread;
+            if (fscanf(fin, "%d %d %lf\n", &iread, &jread, &fread) != 3 || i != iread || j != jread) {
+                printf("read ij error %d %d in %s\n", i, j, file.c_str());
+                fclose(fin);
+                return false;
+            }
+            colMajor[std::size_t(j) * dim + i] = fread; // convert to col major
+        }
+    }
+    fclose(fin);
+    return true;
+}
+
+} // namespace stkfmm
+
+#endif
@@ -0,0 +1,223 @@
+/**
+ * @file RPYWallKernel.hpp
+ * @brief RPY and its Laplace image terms above a no-slip wall in one kernel
+ *
+ * StkWallFMM assembles the RPY wall image system from an RPY field, a Laplace field of
+ * monopoles, dipoles and quadrupoles, and a Laplace field of monopoles and dipoles.
+ * Packed into one kernel, all three fields share one tree and one traversal.
+ *
+ * source, 21 per point:
+ *   fx,fy,fz,b               RPY
+ *   q1, d1x,d1y,d1z, Q1(9)   Laplace S, monopole, dipole, quadrupole
+ *   q2, d2x,d2y,d2z          Laplace SZ, monopole, dipole
+ * target, 20 per point:
+ *   ux,uy,uz,lapux,lapuy,lapuz  RPY
+ *   p1, grad p1, gradgrad p1     Laplace S, xx,xy,xz,yy,yz,zz
+ *   p2, grad p2                  Laplace SZ
+ * equivalent density, 5 per point: Stokeslet fx,fy,fz, Laplace q1, Laplace q2
+ */
+#ifndef RPYWALLKERNEL_HPP_
+#define RPYWALLKERNEL_HPP_
+
+#include "LaplaceLayerKernel.hpp"
+#include "RPYKernel.hpp"
+
+namespace pvfmm {
+
+/**
+ * @brief zero a micro kernel output array
+ *
+ */
+template <class VecType, int N>
+inline void rpyWallZero(VecType (&u)[N]) {
+    for (int i = 0; i < N; i++)
+        u[i] = VecType::Zero();
+}
+
+/**********************************************************
+ *                                                        *
+ *  RPY wall source -> equivalent density, 21 -> 5        *
+ *                                                        *
+ **********************************************************/
+struct rpy_wall_u : public GenericKernel<rpy_wall_u> {
+    static const int FLOPS = 80;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[5], const VecType (&r)[3], const VecType (&f)[21], const void *ctx_ptr) {
+        const VecType two = (typename VecType::ScalarType)(2.0);
+
+        // clang-format off
+        const VecType rpy[4] = {f[0], f[1], f[2], f[3]};
+        const VecType q1[1] = {f[4]};
+        const VecType d1[3] = {f[5], f[6], f[7]};
+        const VecType Q1[9] = {f[8], f[9], f[10], f[11], f[12], f[13], f[14], f[15], f[16]};
+        const VecType q2[1] = {f[17]};
+        const VecType d2[3] = {f[18], f[19], f[20]};
+        // clang-format on
+
+        VecType vel[3], p1[1], p2[1];
+        rpyWallZero(vel);
+        rpyWallZero(p1);
+        rpyWallZero(p2);
+        rpy_u::uKerEval<VecType, digits>(vel, r, rpy, ctx_ptr);
+        laplace_p::uKerEval<VecType, digits>(p1, r, q1, ctx_ptr);
+        laplace_dipolep::uKerEval<VecType, digits>(p1, r, d1, ctx_ptr);
+        laplace_quadp::uKerEval<VecType, digits>(p1, r, Q1, ctx_ptr);
+        laplace_p::uKerEval<VecType, digits>(p2, r, q2, ctx_ptr);
+        laplace_dipolep::uKerEval<VecType, digits>(p2, r, d2, ctx_ptr);
+
+        // Laplace kernels scale as 1/(4 pi)
+        u[0] += vel[0];
+        u[1] += vel[1];
+        u[2] += vel[2];
+        u[3] += two * p1[0];
+        u[4] += two * p2[0];
+    }
+};
+
+/**********************************************************
+ *                                                        *
+ *  equivalent density -> equivalent density, 5 -> 5      *
+ *  Stokeslet velocity and two Laplace potentials         *
+ *                                                        *
+ **********************************************************/
+struct rpy_wall_equiv : public GenericKernel<rpy_wall_equiv> {
+    static const int FLOPS = 30;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[5], const VecType (&r)[3], const VecType (&f)[5], const void *ctx_ptr) {
+        VecType r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+        VecType rinv = sctl::approx_rsqrt<digits>(r2, r2 > VecType::Zero());
+        VecType rinv3 = rinv * rinv * rinv;
+        const VecType two = (typename VecType::ScalarType)(2.0);
+
+        VecType fdotr = f[0] * r[0] + f[1] * r[1] + f[2] * r[2];
+        u[0] += (r2 * f[0] + r[0] * fdotr) * rinv3;
+        u[1] += (r2 * f[1] + r[1] * fdotr) * rinv3;
+        u[2] += (r2 * f[2] + r[2] * fdotr) * rinv3;
+        u[3] += two * f[3] * rinv;
+        u[4] += two * f[4] * rinv;
+    }
+};
+
+/**********************************************************
+ *                                                        *
+ *  equivalent density -> target, 5 -> 20                 *
+ *                                                        *
+ **********************************************************/
+struct rpy_wall_equiv_ulapu : public GenericKernel<rpy_wall_equiv_ulapu> {
+    static const int FLOPS = 80;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[20], const VecType (&r)[3], const VecType (&f)[5], const void *ctx_ptr) {
+        const VecType two = (typename VecType::ScalarType)(2.0);
+        const VecType stk[3] = {f[0], f[1], f[2]};
+        const VecType q1[1] = {f[3]};
+        const VecType q2[1] = {f[4]};
+
+        VecType vel[6], lap1[10], lap2[4];
+        rpyWallZero(vel);
+        rpyWallZero(lap1);
+        rpyWallZero(lap2);
+        stk_ulapu::uKerEval<VecType, digits>(vel, r, stk, ctx_ptr);
+        laplace_pgradgrad::uKerEval<VecType, digits>(lap1, r, q1, ctx_ptr);
+        laplace_pgrad::uKerEval<VecType, digits>(lap2, r, q2, ctx_ptr);
+
+        for (int i = 0; i < 6; i++)
+            u[i] += vel[i];
+        for (int i = 0; i < 10; i++)
+            u[6 + i] += two * lap1[i];
+        for (int i = 0; i < 4; i++)
+            u[16 + i] += two * lap2[i];
+    }
+};
+
+/**********************************************************
+ *                                                        *
+ *  RPY wall source -> target, 21 -> 20                   *
+ *                                                        *
+ **********************************************************/
+struct rpy_wall_ulapu : public GenericKernel<rpy_wall_ulapu> {
+    static const int FLOPS = 300;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[20], const VecType (&r)[3], const VecType (&f)[21], const void *ctx_ptr) {
+        const VecType two = (typename VecType::ScalarType)(2.0);
+
+        // clang-format off
+        const VecType rpy[4] = {f[0], f[1], f[2], f[3]};
+        const VecType q1[1] = {f[4]};
+        const VecType d1[3] = {f[5], f[6], f[7]};
+        const VecType Q1[9] = {f[8], f[9], f[10], f[11], f[12], f[13], f[14], f[15], f[16]};
+        const VecType q2[1] = {f[17]};
+        const VecType d2[3] = {f[18], f[19], f[20]};
+        // clang-format on
+
+        VecType vel[6], lap1[10], lap2[4];
+        rpyWallZero(vel);
+        rpyWallZero(lap1);
+        rpyWallZero(lap2);
+        rpy_ulapu::uKerEval<VecType, digits>(vel, r, rpy, ctx_ptr);
+        laplace_pgradgrad::uKerEval<VecType, digits>(lap1, r, q1, ctx_ptr);
+        laplace_dipolepgradgrad::uKerEval<VecType, digits>(lap1, r, d1, ctx_ptr);
+        laplace_quadpgradgrad::uKerEval<VecType, digits>(lap1, r, Q1, ctx_ptr);
+        laplace_pgrad::uKerEval<VecType, digits>(lap2, r, q2, ctx_ptr);
+        laplace_dipolepgrad::uKerEval<VecType, digits>(lap2, r, d2, ctx_ptr);
+
+        for (int i = 0; i < 6; i++)
+            u[i] += vel[i];
+        for (int i = 0; i < 10; i++)
+            u[6 + i] += two * lap1[i];
+        for (int i = 0; i < 4; i++)
+            u[16 + i] += two * lap2[i];
+    }
+};
+
+/**
+ * @brief RPY wall image kernel
+ *
+ * @tparam T float or double
+ */
+template <class T>
+struct RPYWallKernel {
+    inline static const Kernel<T> &ulapu(); ///< 21 -> 20, see the file comment
+};
+
+template <class T>
+inline const Kernel<T> &RPYWallKernel<T>::ulapu() {
+    // the periodic M2C of rpy_wall is assembled from stokes_vel and laplace, see FMMData::setupPeriodicData()
+    static Kernel<T> equiv_ker =
+        BuildKernel<T, rpy_wall_equiv::Eval<T>>("rpy_wall", 3, std::pair<int, int>(5, 5));
+    static Kernel<T> s2equiv_ker = BuildKernel<T, rpy_wall_u::Eval<T>>("rpy_wall_u", 3, std::pair<int, int>(21, 5));
+    static Kernel<T> equiv2t_ker =
+        BuildKernel<T, rpy_wall_equiv_ulapu::Eval<T>>("rpy_wall_equiv_ulapu", 3, std::pair<int, int>(5, 20));
+
+    static Kernel<T> wall_ker =
+        BuildKernel<T, rpy_wall_ulapu::Eval<T>>("rpy_wall_ulapu", 3, std::pair<int, int>(21, 20),
+                                                &s2equiv_ker, // k_s2m
+                                                &s2equiv_ker, // k_s2l
+                                                NULL,         // k_s2t
+                                                &equiv_ker,   // k_m2m
+                                                &equiv_ker,   // k_m2l
+                                                &equiv2t_ker, // k_m2t
+                                                &equiv_ker,   // k_l2l
+                                                &equiv2t_ker, // k_l2t
+                                                NULL);
+    return wall_ker;
+}
+
+} // namespace pvfmm
+
+#endif
@@ -9,6 +9,9 @@ void Stk3DFMM_destroy(Stk3DFMM *fmm);
 void Stk3DFMM_set_points(Stk3DFMM *fmm, const int nSL, double *src_SL_coord, const int nTrg, double *trg_coord,
                          const int nDL, double *src_DL_coord);
 
+int Stk3DFMM_update_points(Stk3DFMM *fmm, const int nSL, double *src_SL_coord, const int nTrg, double *trg_coord,
+                           const int nDL, double *src_DL_coord);
+
 void Stk3DFMM_set_box(Stk3DFMM *fmm, double *origin, double len);
 
 void Stk3DFMM_setup_tree(Stk3DFMM *fmm, unsigned kernel);
@@ -16,8 +19,20 @@ void Stk3DFMM_setup_tree(Stk3DFMM *fmm, unsigned kernel);
 void Stk3DFMM_evaluate_fmm(Stk3DFMM *fmm, unsigned kernel, const int nSL, double *src_SL_value, const int nTrg,
                            double *trg_value, const int nDL, double *src_DL_value);
 
+void Stk3DFMM_evaluate_fmm_batch(Stk3DFMM *fmm, unsigned kernel, const int nRHS, const int nSL,
+                                 double *src_SL_value, const int nTrg, double *trg_value, const int nDL,
+                                 double *src_DL_value);
+
 void Stk3DFMM_show_active_kernels(Stk3DFMM *fmm);
 
+// wall time of each phase, min/avg/max over ranks, arrays of 7: ingest, treeBuild, setupFMM, fmm, periodize, scaling,
+// copyOut
+void Stk3DFMM_get_perf_counters(Stk3DFMM *fmm, unsigned kernel, double *min, double *avg, double *max);
+
+void Stk3DFMM_reset_perf_counters(Stk3DFMM *fmm);
+
+void Stk3DFMM_dump_perf_counters(Stk3DFMM *fmm, const char *file);
+
 
 StkWallFMM *StkWallFMM_create(int mult_order, int max_pts, int pbc, unsigned kernelComb);
 
@@ -33,4 +48,19 @@ void StkWallFMM_setup_tree(StkWallFMM *fmm, unsigned kernel);
 void StkWallFMM_evaluate_fmm(StkWallFMM *fmm, unsigned kernel, const int nSL, double *src_SL_value, const int nTrg,
                            double *trg_value, const int nDL, double *src_DL_value);
 
+void StkWallFMM_evaluate_fmm_batch(StkWallFMM *fmm, unsigned kernel, const int nRHS, const int nSL,
+                                   double *src_SL_value, const int nTrg, double *trg_value, const int nDL,
+                                   double *src_DL_value);
+
 void StkWallFMM_show_active_kernels(StkWallFMM *fmm);
+
+// wall time of each phase, min/avg/max over ranks, arrays of 7: ingest, treeBuild, setupFMM, fmm, periodize, scaling,
+// copyOut
+void StkWallFMM_get_perf_counters(StkWallFMM *fmm, unsigned kernel, double *min, double *avg, double *max);
+
+void StkWallFMM_reset_perf_counters(StkWallFMM *fmm);
+
+void StkWallFMM_dump_perf_counters(StkWallFMM *fmm, const char *file);
+
+// free the shared periodic operators no FMM object uses, collective over MPI_COMM_WORLD
+void STKFMM_release_operators();
@@ -14,6 +14,11 @@
 
 #include "STKFMM_common.hpp"
 #include "STKFMM_impl.hpp"
+#include "TaskQueue.hpp"
+
+#include <functional>
+#include <future>
+#include <memory>
 
 /**
  * @brief namespace for stkfmm
@@ -25,6 +30,29 @@ namespace stkfmm {
  */
 bool get_verbosity();
 
+/**
+ * @brief multipole order and leaf size chosen for a target accuracy
+ *
+ */
+struct FMMParameters {
+    int multOrder;        ///< multipole order
+    int maxPts;           ///< max number of points in an octree leaf box
+    double expectedError; ///< typical relative L2 error of the least accurate kernel at multOrder
+};
+
+/**
+ * @brief choose multOrder and maxPts for a target relative error
+ * from the convergence and timing sweeps of TestFMM.X on random points in free space.
+ * Clustered or periodic systems can be less accurate, check with Stk3DFMM::checkError() on the actual points
+ *
+ * @param tolerance target relative L2 error
+ * @param kernelComb combination of kernels to be activated
+ * @param precision working precision
+ * @return the lowest order meeting tolerance, or the highest order available
+ */
+FMMParameters chooseParameters(const double tolerance, const unsigned int kernelComb,
+                               const PRECISION precision = PRECISION::DOUBLE);
+
 /**
  * @brief a virtual interface for STKFMM cases
  *
@@ -38,8 +66,11 @@ class STKFMM {
      * @param maxPts_
      * @param pbc_
      * @param kernelComb_
+     * @param enableFF_
+     * @param precision_ working precision of the FMM, inputs and outputs are double regardless
      */
-    STKFMM(int multOrder_, int maxPts_, PAXIS pbc_, unsigned int kernelComb_, bool enableFF_ = true);
+    STKFMM(int multOrder_, int maxPts_, PAXIS pbc_, unsigned int kernelComb_, bool enableFF_ = true,
+           PRECISION precision_ = PRECISION::DOUBLE);
 
     /**
      * @brief Set FMM Box
@@ -64,9 +95,23 @@ class STKFMM {
     virtual void setPoints(const int nSL, const double *srcSLCoordPtr, const int nTrg, const double *trgCoordPtr,
                            const int nDL = 0, const double *srcDLCoordPtr = nullptr) = 0;
 
+    /**
+     * @brief Update point coordinates for the next time step, collective
+     * same as setPoints(), with the points in the same number and order on each rank as in the last setPoints().
+     * Stk3DFMM keeps the tree of a kernel if no point left its leaf and getImbalance() stays below the threshold
+     * set by setImbalanceThreshold(), otherwise the tree is deleted and rebuilt by the next setupTree()
+     *
+     * @return true if all trees are kept, false if setupTree() must be called again for the kernels in use
+     */
+    virtual bool updatePoints(const int nSL, const double *srcSLCoordPtr, const int nTrg, const double *trgCoordPtr,
+                              const int nDL = 0, const double *srcDLCoordPtr = nullptr);
+
     /**
      * @brief setup the tree for the chosen kernel
      * setPoints() must have been called
+     * each kernel has its own octree, pvfmm cannot share one tree between kernels.
+     * It is kept until the next setPoints() or updatePoints() rebuild, Stk3DFMM skips a kernel whose tree is already
+     * set up
      *
      * @param kernel one of the activated kernels to use
      */
@@ -74,7 +119,7 @@ class STKFMM {
 
     /**
      * @brief evaluate FMM
-     * results are added to values already in trgValuePtr
+     * results are added to values already in trgValuePtr, or replace them with EVALMODE::OVERWRITE
      * setPoints() and setupTree() must be called first
      * nSL, nDL, nTrg must be the same as used by setPoints()
      * length of arrays must match (kdimSL,kdimDL,kdimTrg) in the chosen kernel
@@ -86,9 +131,91 @@ class STKFMM {
      * @param srcDLValuePtr pointer to double layer source value
      * @param nTrg target point number
      * @param trgValuePtr pointer to target value
+     * @param mode accumulate or overwrite trgValuePtr
      */
     virtual void evaluateFMM(const KERNEL kernel, const int nSL, const double *srcSLValuePtr, const int nTrg,
-                             double *trgValuePtr, const int nDL = 0, const double *srcDLValuePtr = nullptr) = 0;
+                             double *trgValuePtr, const int nDL = 0, const double *srcDLValuePtr = nullptr,
+                             const EVALMODE mode = EVALMODE::ACCUMULATE) = 0;
+
+    /**
+     * @brief evaluate several kernels on the same points in one call
+     * Stk3DFMM evaluates Stokes and LapPGrad together with one fused kernel, one tree and one traversal,
+     * and PVel and Traction too if their source values are the same arrays.
+     * Other kernels are set up if needed and evaluated one after another.
+     * nSL, nDL, nTrg must be the same as used by setPoints()
+     * the k-th value arrays must match (kdimSL,kdimDL,kdimTrg) of kernels[k]
+     *
+     * @param kernels activated kernels to evaluate, each at most once
+     * @param nSL single layer source point number
+     * @param srcSLValuePtrs pointers to single layer source value, one per kernel
+     * @param nTrg target point number
+     * @param trgValuePtrs pointers to target value, one per kernel
+     * @param nDL double layer source point number
+     * @param srcDLValuePtrs pointers to double layer source value, one per kernel, or empty if no kernel has DL
+     * @param mode accumulate or overwrite trgValuePtrs
+     */
+    void evaluateFMM(const std::vector<KERNEL> &kernels, const int nSL,
+                     const std::vector<const double *> &srcSLValuePtrs, const int nTrg,
+                     const std::vector<double *> &trgValuePtrs, const int nDL = 0,
+                     const std::vector<const double *> &srcDLValuePtrs = std::vector<const double *>(),
+                     const EVALMODE mode = EVALMODE::ACCUMULATE);
+
+    /**
+     * @brief evaluate nRHS value sets of one kernel on the same points
+     * value k of set r at point i is at index (i * nRHS + r) * kdim + k of each array.
+     * Stk3DFMM evaluates Stokes, RPY and LapPGrad nBatchRHS sets at a time with a batched kernel,
+     * one tree traversal per batch. the remaining sets and other kernels are evaluated one set at a time.
+     * setPoints() must be called first, the trees are set up if needed
+     * nSL, nDL, nTrg must be the same as used by setPoints()
+     *
+     * @param kernel one of the activated kernels to evaluate
+     * @param nRHS number of value sets
+     * @param nSL single layer source point number
+     * @param srcSLValuePtr pointer to single layer source value, nRHS * kdimSL per point
+     * @param nTrg target point number
+     * @param trgValuePtr pointer to target value, nRHS * kdimTrg per point
+     * @param nDL double layer source point number
+     * @param srcDLValuePtr pointer to double layer source value, nRHS * kdimDL per point, nullptr for zero
+     * @param mode accumulate or overwrite trgValuePtr
+     */
+    virtual void evaluateFMMBatch(const KERNEL kernel, const int nRHS, const int nSL, const double *srcSLValuePtr,
+                                  const int nTrg, double *trgValuePtr, const int nDL = 0,
+                                  const double *srcDLValuePtr = nullptr, const EVALMODE mode = EVALMODE::ACCUMULATE);
+
+    /**
+     * @brief non-blocking setupTree()
+     * runs on the setup worker thread of this object, in submission order with other setupTreeAsync() calls.
+     * all ranks must submit in the same order.
+     * do not call other member functions of this object until the future is ready.
+     * for double buffering use two objects, e.g. setPoints() and setupTreeAsync() for step n+1 on one
+     * while evaluateFMMAsync() of step n runs on the other.
+     * runs synchronously unless MPI provides MPI_THREAD_MULTIPLE
+     *
+     * @param kernel one of the activated kernels to use
+     * @return std::future<void> ready when the tree is set up
+     */
+    std::future<void> setupTreeAsync(KERNEL kernel);
+
+    /**
+     * @brief non-blocking evaluateFMM()
+     * runs on the evaluation worker thread of this object, with the same rules as setupTreeAsync().
+     * value arrays must stay valid until the future is ready
+     *
+     * @return std::future<void> ready when trgValuePtr is written
+     */
+    std::future<void> evaluateFMMAsync(const KERNEL kernel, const int nSL, const double *srcSLValuePtr, const int nTrg,
+                                       double *trgValuePtr, const int nDL = 0, const double *srcDLValuePtr = nullptr,
+                                       const EVALMODE mode = EVALMODE::ACCUMULATE);
+
+    /**
+     * @brief number of OpenMP threads of the setup and evaluation workers of this object
+     * call before the first asynchronous call. The default is half of omp_get_max_threads() each,
+     * so that the setup of one object and the evaluation of another can overlap without oversubscription
+     *
+     * @param nSetupThreads threads of setupTreeAsync()
+     * @param nEvalThreads threads of evaluateFMMAsync()
+     */
+    void setAsyncThreads(int nSetupThreads, int nEvalThreads);
 
     /**
      * @brief evaluate kernel functions by direct O(N^2) summation without FMM
@@ -129,6 +256,93 @@ class STKFMM {
      */
     void showActiveKernels() const;
 
+    /**
+     * @brief activate more kernels after construction, collective
+     *
+     * @param kernelComb_ combination of kernels to activate
+     */
+    virtual void enableKernels(unsigned int kernelComb_) = 0;
+
+    /**
+     * @brief initialize all activated kernels now instead of at their first setupTree(), collective
+     * kernels are initialized concurrently with a share of the OpenMP threads each,
+     * if MPI provides MPI_THREAD_MULTIPLE and maxPts is not 0
+     *
+     */
+    void initializeKernels();
+
+    /**
+     * @brief partition trees by estimated near-field and far-field work instead of point count
+     * call before setPoints(), takes effect when the trees are set up
+     *
+     * @param costWeighted_
+     */
+    void setCostWeighted(bool costWeighted_);
+
+    /**
+     * @brief max load imbalance at which updatePoints() keeps a tree, 1.2 by default
+     * a tree above it is rebuilt, which repartitions the points over the ranks
+     *
+     * @param threshold max over ranks / mean of the estimated work, as in getImbalance()
+     */
+    void setImbalanceThreshold(double threshold);
+
+    /**
+     * @brief load imbalance of the tree for a kernel, collective
+     * max over ranks / mean of the estimated work of the points each rank owns
+     *
+     * @param kernel one of the kernels in use, for StkWallFMM including the Laplace image kernels
+     * @return 1 if balanced or the tree is not set up
+     */
+    double getImbalance(KERNEL kernel);
+
+    /**
+     * @brief memory used by a kernel only, reduced over ranks, collective
+     *
+     * @param kernel one of the kernels in use, for StkWallFMM including the Laplace image kernels
+     * @return MemoryReport
+     */
+    MemoryReport getMemoryUsage(KERNEL kernel) const;
+
+    /**
+     * @brief memory shared by kernels, and process-level resident memory, reduced over ranks, collective
+     * report these once, they are not part of any kernel
+     *
+     * @return ProcessMemoryReport
+     */
+    ProcessMemoryReport getMemoryUsage() const;
+
+    /**
+     * @brief wall time of each PHASE for a kernel since construction or resetPerfCounters(),
+     * min/avg/max over ranks, collective.
+     * setPoints() is shared by all kernels and counted in the INGEST phase of each of them
+     *
+     * @param kernel one of the kernels in use, for StkWallFMM including the Laplace image kernels
+     * @return PerfReport
+     */
+    PerfReport getPerfCounters(KERNEL kernel) const;
+
+    /**
+     * @brief zero the PerfCounters of all kernels on this rank, and reset the peak resident memory of the process
+     *
+     */
+    void resetPerfCounters();
+
+    /**
+     * @brief write getPerfCounters() of all kernels in use to a JSON file, collective
+     * only rank 0 writes
+     *
+     * @param file
+     */
+    void dumpPerfCounters(const std::string &file) const;
+
+    /**
+     * @brief free the shared periodic operators that no FMM object uses any more, collective over MPI_COMM_WORLD
+     * Destroying an FMM object keeps its operators, so a later FMM object with the same kernels, order and
+     * periodicity does not read them again. Call on all ranks while no FMM object is being constructed
+     */
+    static void releaseOperators();
+
     /**
      * @brief show if a kernel is activated
      *
@@ -145,12 +359,21 @@ class STKFMM {
      */
     int getMultOrder() const { return multOrder; }
 
+    /**
+     * @brief Get working precision
+     *
+     * @return PRECISION
+     */
+    PRECISION getPrecision() const { return precision; }
+
   protected:
     int rank;                  ///< MPI rank
     const int multOrder;       ///< multipole order
     const int maxPts;          ///< max number of points to use
     PAXIS pbc;                 ///< periodic boundary condition
-    const unsigned kernelComb; ///< combination of activated kernels
+    unsigned kernelComb;       ///< combination of activated kernels
+    const bool enableFF;       ///< enable periodic Far-Field fix
+    const PRECISION precision; ///< working precision of all FMMData
 
     double origin[3];   ///< coordinate of box origin
     double len;         ///< cubic box size
@@ -163,8 +386,36 @@ class STKFMM {
     std::vector<double> srcDLValueInternal; ///< scaled DL value
     std::vector<double> trgValueInternal;   ///< scaled trg value
 
+    bool trgIsSrcSL = false; ///< targets are the SL sources, stored once in srcSLCoordInternal
+    int nTrgInternal = 0;    ///< number of targets on this rank
+
+    double imbalanceThreshold = 1.2; ///< max load imbalance at which updatePoints() keeps a tree
+
     std::unordered_map<KERNEL, impl::FMMData *> poolFMM; ///< all FMMData objects
 
+    int asyncThreads[2] = {0, 0};                ///< OpenMP threads of the setup and evaluation workers
+    std::unique_ptr<impl::TaskQueue> setupQueue; ///< worker of setupTreeAsync(), started at the first call
+    std::unique_ptr<impl::TaskQueue> evalQueue;  ///< worker of evaluateFMMAsync(), started at the first call
+
+    /**
+     * @brief finish pending asynchronous calls and join the workers
+     * called first in the destructors, before the FMMData the tasks use are deleted
+     */
+    void stopAsync();
+
+    /**
+     * @brief evaluate the kernels of evaluateFMM(kernels, ...) that run fused with another one
+     * arguments as in evaluateFMM(kernels, ...), srcDLValuePtrs has one entry per kernel.
+     * The default fuses nothing
+     *
+     * @param done set to true for the kernels evaluated here
+     */
+    virtual void evaluateFused(const std::vector<KERNEL> &kernels, const int nSL,
+                               const std::vector<const double *> &srcSLValuePtrs, const int nTrg,
+                               const std::vector<double *> &trgValuePtrs, const int nDL,
+                               const std::vector<const double *> &srcDLValuePtrs, const EVALMODE mode,
+                               std::vector<bool> &done) {}
+
     /**
      * @brief scale and shift coordPtr
      *
@@ -173,6 +424,41 @@ class STKFMM {
      */
     void scaleCoord(const int npts, double *coordPtr) const;
 
+    /**
+     * @brief check if the targets are the SL sources, passed as the same array
+     *
+     * @param nSL single layer source point number
+     * @param srcSLCoordPtr single layer source coordinate
+     * @param nTrg target point number
+     * @param trgCoordPtr target coordinate
+     * @return true if targets and SL sources coincide
+     */
+    static bool sharedPoints(const int nSL, const double *srcSLCoordPtr, const int nTrg, const double *trgCoordPtr);
+
+    /**
+     * @brief scaled target coordinate, nTrgInternal points
+     * the leading nTrgInternal SL points if trgIsSrcSL
+     *
+     * @return const double*
+     */
+    const double *trgCoordData() const { return trgIsSrcSL ? srcSLCoordInternal.data() : trgCoordInternal.data(); }
+
+    /**
+     * @brief run tasks on their own threads with a share of the OpenMP threads each, and wait for all of them
+     * runs the tasks one after another if MPI does not provide MPI_THREAD_MULTIPLE
+     * Remark: tasks must not share an FMMData, each FMMData has its own communicator
+     *
+     * @param tasks
+     */
+    static void runConcurrently(const std::vector<std::function<void()>> &tasks);
+
+    /**
+     * @brief bytes of STKFMM copies of points and values on this rank
+     *
+     * @return std::size_t
+     */
+    virtual std::size_t internalBytes() const;
+
     /**
      * @brief handle pbc [0,1) of coordPtr
      *
@@ -195,17 +481,32 @@ class Stk3DFMM : public STKFMM {
      * @param maxPts
      * @param pbc_
      * @param kernelComb_
+     * @param enableFF_
+     * @param precision_
      */
     Stk3DFMM(int multOrder = 10, int maxPts = 2000, PAXIS pbc_ = PAXIS::NONE,
-             unsigned int kernelComb_ = asInteger(KERNEL::Stokes) | asInteger(KERNEL::RPY), bool enableFF_ = true);
+             unsigned int kernelComb_ = asInteger(KERNEL::Stokes) | asInteger(KERNEL::RPY), bool enableFF_ = true,
+             PRECISION precision_ = PRECISION::DOUBLE);
 
     virtual void setPoints(const int nSL, const double *srcSLCoordPtr, const int nTrg, const double *trgCoordPtr,
                            const int nDL = 0, const double *srcDLCoordPtr = nullptr);
 
+    virtual bool updatePoints(const int nSL, const double *srcSLCoordPtr, const int nTrg, const double *trgCoordPtr,
+                              const int nDL = 0, const double *srcDLCoordPtr = nullptr);
+
     virtual void setupTree(KERNEL kernel);
 
     virtual void evaluateFMM(const KERNEL kernel, const int nSL, const double *srcSLValuePtr, const int nTrg,
-                             double *trgValuePtr, const int nDL = 0, const double *srcDLValuePtr = nullptr);
+                             double *trgValuePtr, const int nDL = 0, const double *srcDLValuePtr = nullptr,
+                             const EVALMODE mode = EVALMODE::ACCUMULATE);
+
+    using STKFMM::evaluateFMM;
+
+    virtual void evaluateFMMBatch(const KERNEL kernel, const int nRHS, const int nSL, const double *srcSLValuePtr,
+                                  const int nTrg, double *trgValuePtr, const int nDL = 0,
+                                  const double *srcDLValuePtr = nullptr, const EVALMODE mode = EVALMODE::ACCUMULATE);
+
+    virtual void enableKernels(unsigned int kernelComb_);
 
     virtual void clearFMM(KERNEL kernel);
 
@@ -213,7 +514,54 @@ class Stk3DFMM : public STKFMM {
         return std::make_tuple(origin[0], origin[0] + len, origin[1], origin[1] + len, origin[2], origin[2] + len);
     };
 
+    /**
+     * @brief relative L2 error of evaluateFMM() results on a random sample of targets
+     * compared to direct summation over all sources on all ranks, free space only.
+     * collective, all sources are gathered on every rank
+     *
+     * @param kernel the kernel evaluated
+     * @param nSample number of targets sampled on each rank
+     * @param nSL number of SL sources on this rank
+     * @param srcSLCoordPtr SL source coordinates
+     * @param srcSLValuePtr SL source values
+     * @param nTrg number of targets on this rank
+     * @param trgCoordPtr target coordinates
+     * @param trgValuePtr target values computed by evaluateFMM()
+     * @param nDL number of DL sources on this rank
+     * @param srcDLCoordPtr DL source coordinates
+     * @param srcDLValuePtr DL source values
+     * @return relative L2 error, -1 if not available for this boundary condition
+     */
+    double checkError(const KERNEL kernel, const int nSample, const int nSL, const double *srcSLCoordPtr,
+                      const double *srcSLValuePtr, const int nTrg, const double *trgCoordPtr,
+                      const double *trgValuePtr, const int nDL = 0, const double *srcDLCoordPtr = nullptr,
+                      const double *srcDLValuePtr = nullptr);
+
+    /**
+     * @brief destroy the FMM object, its shared operators stay cached until releaseOperators()
+     *
+     */
     ~Stk3DFMM();
+
+  protected:
+    /**
+     * @brief scale, wrap and store point coordinates in the internal arrays, the trees are not touched
+     * parameters are the same as setPoints()
+     */
+    void storePoints(const int nSL, const double *srcSLCoordPtr, const int nTrg, const double *trgCoordPtr,
+                     const int nDL, const double *srcDLCoordPtr);
+
+    /**
+     * @brief evaluate Stokes and LapPGrad with the fused kernel StokesLapPGrad if both are requested,
+     * PVel and Traction with PVelTraction if both are requested with the same source arrays.
+     * a fused FMMData is created at the first such call
+     *
+     */
+    virtual void evaluateFused(const std::vector<KERNEL> &kernels, const int nSL,
+                               const std::vector<const double *> &srcSLValuePtrs, const int nTrg,
+                               const std::vector<double *> &trgValuePtrs, const int nDL,
+                               const std::vector<const double *> &srcDLValuePtrs, const EVALMODE mode,
+                               std::vector<bool> &done);
 };
 
 /**
@@ -229,9 +577,12 @@ class StkWallFMM : public STKFMM {
      * @param maxPts
      * @param pbc_
      * @param kernelComb_
+     * @param enableFF_
+     * @param precision_
      */
     StkWallFMM(int multOrder = 10, int maxPts = 2000, PAXIS pbc_ = PAXIS::NONE,
-               unsigned int kernelComb_ = asInteger(KERNEL::Stokes) | asInteger(KERNEL::RPY), bool enableFF_ = true);
+               unsigned int kernelComb_ = asInteger(KERNEL::Stokes) | asInteger(KERNEL::RPY), bool enableFF_ = true,
+               PRECISION precision_ = PRECISION::DOUBLE);
 
     virtual void setPoints(const int nSL, const double *srcSLCoordPtr, const int nTrg, const double *trgCoordPtr,
                            const int nDL = 0, const double *srcDLCoordPtr = nullptr);
@@ -239,7 +590,12 @@ class StkWallFMM : public STKFMM {
     virtual void setupTree(KERNEL kernel);
 
     virtual void evaluateFMM(const KERNEL kernel, const int nSL, const double *srcSLValuePtr, const int nTrg,
-                             double *trgValuePtr, const int nDL = 0, const double *srcDLValuePtr = nullptr);
+                             double *trgValuePtr, const int nDL = 0, const double *srcDLValuePtr = nullptr,
+                             const EVALMODE mode = EVALMODE::ACCUMULATE);
+
+    using STKFMM::evaluateFMM;
+
+    virtual void enableKernels(unsigned int kernelComb_);
 
     virtual void clearFMM(KERNEL kernel);
 
@@ -247,11 +603,27 @@ class StkWallFMM : public STKFMM {
         return std::make_tuple(origin[0], origin[0] + len, origin[1], origin[1] + len, origin[2], origin[2] + len);
     };
 
+    /**
+     * @brief destroy the FMM object, its shared operators stay cached until releaseOperators()
+     *
+     */
     ~StkWallFMM();
 
   protected:
-    std::vector<double> srcSLImageCoordInternal;  ///< scaled SL point coord
-    std::vector<double> srcSLOriginCoordInternal; ///< scaled SL image point coord
+    // srcSLCoordInternal holds nSL origins followed by their nSL images
+    // workspace of the image systems, sized in setPoints()
+    std::vector<double> srcValStk, trgValStk;         ///< Stokes, 3->3
+    std::vector<double> srcValL1, srcValD, trgValL1D; ///< LapPGrad, 1/3->4
+    std::vector<double> srcValL2, trgValL2;           ///< LapPGradGrad, 1->10
+    std::vector<double> srcValRPY, trgValRPY;         ///< RPYWall, 21->20
+
+    virtual std::size_t internalBytes() const;
+
+    /**
+     * @brief size and zero the workspace of the activated image systems
+     *
+     */
+    void setupWorkspace();
 
     /**
      * @brief evaluate Stokes image system
@@ -266,6 +638,23 @@ class StkWallFMM : public STKFMM {
     void evalRPY();
 };
 
+/**
+ * @brief construct an FMM object with multOrder and maxPts from chooseParameters()
+ *
+ * @tparam FMM Stk3DFMM or StkWallFMM
+ * @param tolerance target relative L2 error
+ * @param pbc_
+ * @param kernelComb_
+ * @param precision_
+ * @return std::shared_ptr<FMM>
+ */
+template <class FMM>
+std::shared_ptr<FMM> createFMM(const double tolerance, const PAXIS pbc_, const unsigned int kernelComb_,
+                               const PRECISION precision_ = PRECISION::DOUBLE) {
+    const FMMParameters param = chooseParameters(tolerance, kernelComb_, precision_);
+    return std::make_shared<FMM>(param.multOrder, param.maxPts, pbc_, kernelComb_, true, precision_);
+}
+
 } // namespace stkfmm
 
 #endif
@@ -4,8 +4,11 @@
 #include <pvfmm.hpp>
 #include <intrin_wrapper.hpp>
 
+#include "BatchKernel.hpp"
 #include "LaplaceLayerKernel.hpp"
 #include "RPYKernel.hpp"
+#include "RPYWallKernel.hpp"
+#include "StokesLaplaceKernel.hpp"
 #include "StokesLayerKernel.hpp"
 #include "StokesRegSingleLayerKernel.hpp"
 
@@ -40,6 +43,106 @@ enum class PPKERNEL : unsigned {
     L2T = 4,   ///< L -> T kernel
 };
 
+/**
+ * @brief how evaluateFMM() writes to the target value array
+ *
+ */
+enum class EVALMODE : unsigned {
+    ACCUMULATE = 0, ///< add results to values already in the array
+    OVERWRITE = 1,  ///< replace values in the array, no need to zero it beforehand
+};
+
+/**
+ * @brief working precision of the FMM tree, translation operators and kernels
+ * coordinates and values passed to the library are always double
+ *
+ */
+enum class PRECISION : unsigned {
+    DOUBLE = 0, ///< double precision throughout
+    FLOAT = 1,  ///< single precision, about 6 digits at most, faster and half the memory
+};
+
+/**
+ * @brief memory used for one kernel on one rank, in bytes
+ *
+ */
+struct MemoryUsage {
+    std::size_t periodic = 0; ///< single precision copy of the periodic M2C operator, 0 in double precision
+    std::size_t tree = 0;     ///< points, values and equivalent densities in the local and ghost tree nodes
+    std::size_t work = 0;     ///< scaled source and target value buffers passed to pvfmm
+};
+
+/**
+ * @brief memory of one rank not owned by a single kernel, in bytes
+ * operators and peakResident are measured on the whole process,
+ * so they include other threads and other FMM objects working at the same time
+ *
+ */
+struct ProcessMemoryUsage {
+    std::size_t operators = 0;    ///< resident memory growth while pvfmm translation operators were initialized
+    std::size_t periodic = 0;     ///< periodic M2C operators in double precision, one copy per node for all kernels
+    std::size_t internal = 0;     ///< STKFMM copies of coordinates and values, and workspace, shared by all kernels
+    std::size_t peakResident = 0; ///< peak resident memory since the process started or resetPerfCounters()
+};
+
+/**
+ * @brief MemoryUsage reduced over ranks
+ *
+ */
+struct MemoryReport {
+    MemoryUsage min; ///< minimum over ranks
+    MemoryUsage max; ///< maximum over ranks
+    MemoryUsage sum; ///< sum over ranks
+};
+
+/**
+ * @brief ProcessMemoryUsage reduced over ranks
+ *
+ */
+struct ProcessMemoryReport {
+    ProcessMemoryUsage min; ///< minimum over ranks
+    ProcessMemoryUsage max; ///< maximum over ranks
+    ProcessMemoryUsage sum; ///< sum over ranks
+};
+
+/**
+ * @brief phases of setupTree() and evaluateFMM() timed for each kernel
+ *
+ */
+enum class PHASE : unsigned {
+    INGEST = 0,    ///< copy, scale and convert coordinates, setPoints() is shared and counted for every kernel
+    TREEBUILD = 1, ///< octree construction and partition
+    SETUPFMM = 2,  ///< pvfmm SetupFMM, interaction lists and precomputed buffers
+    FMM = 3,       ///< pvfmm evaluation, upward pass, M2L, downward pass and P2P
+    PERIODIZE = 4, ///< periodic far-field correction
+    SCALING = 5,   ///< scale source values to the [0,1) box
+    COPYOUT = 6,   ///< scale target values and write them to the user arrays
+};
+
+constexpr int NPHASE = 7; ///< number of PHASE
+
+/**
+ * @brief accumulated wall time of one kernel on one rank
+ *
+ */
+struct PerfCounters {
+    double seconds[NPHASE] = {}; ///< wall time of each PHASE, indexed by asInteger(PHASE)
+    long setupCalls = 0;         ///< number of trees set up
+    long evaluateCalls = 0;      ///< number of FMM evaluations, batched kernels count one per batch
+};
+
+/**
+ * @brief PerfCounters reduced over ranks
+ *
+ */
+struct PerfReport {
+    double min[NPHASE]; ///< minimum over ranks
+    double avg[NPHASE]; ///< mean over ranks
+    double max[NPHASE]; ///< maximum over ranks
+    long setupCalls;    ///< number of trees set up, the same on all ranks
+    long evaluateCalls; ///< number of FMM evaluations as in PerfCounters, the same on all ranks
+};
+
 /**
  * @brief choose a kernel
  */
@@ -58,15 +161,41 @@ enum class KERNEL : unsigned {
     PVelLaplacian = 512, ///< Stokes
     Traction = 1024,     ///< Stokes
 
-    LapGrad = 2048
+    LapGrad = 2048,
+
+    RPYWall = 4096,        ///< RPY wall image system, used internally by StkWallFMM
+    StokesLapPGrad = 8192, ///< Stokes and LapPGrad fused, used internally by Stk3DFMM
+    PVelTraction = 16384,  ///< PVel and Traction fused, used internally by Stk3DFMM
+
+    StokesBatch = 32768,    ///< Stokes, nBatchRHS value sets, used internally by Stk3DFMM
+    RPYBatch = 65536,       ///< RPY, nBatchRHS value sets, used internally by Stk3DFMM
+    LapPGradBatch = 131072, ///< LapPGrad, nBatchRHS value sets, used internally by Stk3DFMM
 };
 
+/**
+ * @brief number of value sets one batched kernel evaluates at once
+ *
+ */
+constexpr int nBatchRHS = pvfmm::BatchKernel<double>::nRHS;
+
+/**
+ * @brief map of kernel -> its batched kernel, for the kernels having one
+ *
+ */
+extern const std::unordered_map<KERNEL, KERNEL> batchKernelMap;
+
 /**
  * @brief map of kernel -> kernel function pointer
  *
  */
 extern const std::unordered_map<KERNEL, const pvfmm::Kernel<double> *> kernelMap;
 
+/**
+ * @brief map of kernel -> single precision kernel function pointer
+ *
+ */
+extern const std::unordered_map<KERNEL, const pvfmm::Kernel<float> *> kernelMapFloat;
+
 /**
  * @brief Get kernel dimension
  *
@@ -84,6 +213,14 @@ std::tuple<int, int, int> getKernelDimension(KERNEL kernel_);
  */
 std::string getKernelName(KERNEL kernel_);
 
+/**
+ * @brief Get the name of a phase, as used in dumpPerfCounters()
+ *
+ * @param phase_
+ * @return std::string
+ */
+std::string getPhaseName(PHASE phase_);
+
 /**
  * @brief Get the Kernel Function Pointer
  *
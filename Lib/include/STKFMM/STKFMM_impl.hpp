@@ -1,8 +1,11 @@
 #ifndef STKFMM_IMPL_
 #define STKFMM_IMPL_
 
+#include "CostModel.hpp"
+#include "OperatorCache.hpp"
 #include "STKFMM_common.hpp"
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 
@@ -10,6 +13,67 @@ namespace stkfmm {
 
 namespace impl {
 
+/**
+ * @brief pvfmm PtFMM with its translation operators (M2M, M2L, L2L, ...) in a given Precomp file
+ * pvfmm builds the file name from $PVFMM_DIR only if none is set, so the environment is never changed.
+ * All objects in the process initialized with the same file share one PrecompMat
+ *
+ * @tparam Real float or double
+ */
+template <class Real>
+class PrecompFMM : public pvfmm::PtFMM<Real> {
+  public:
+    ~PrecompFMM();
+
+    /**
+     * @brief initialize the translation operators, collective over comm
+     * loaded from file if it exists, otherwise computed and written to file by rank 0.
+     * If another object on every rank already holds the operators of file, they are shared and nothing is
+     * loaded or computed
+     *
+     * @param multOrder multipole order
+     * @param comm communicator of the FMM object
+     * @param kernel pvfmm kernel in precision Real
+     * @param file Precomp file, named after the far-field kernels
+     */
+    void Initialize(int multOrder, MPI_Comm comm, const pvfmm::Kernel<Real> *kernel, const std::string &file);
+
+  private:
+    std::shared_ptr<pvfmm::PrecompMat<Real>> shared; ///< owns this->mat, shared by objects with the same file
+};
+
+/**
+ * @brief pvfmm objects in the working precision of one FMMData
+ *
+ * @tparam Real float or double
+ */
+template <class Real>
+struct FMMEngine {
+    PrecompFMM<Real> matrix;                 ///< pvfmm translation operators
+    pvfmm::PtFMM_Tree<Real> *tree = nullptr; ///< pvfmm octree
+    std::vector<Real> M2C;                   ///< periodicity M2C operator converted to Real, empty for double
+    std::vector<Real> srcSLValue;            ///< scaled SL value passed to pvfmm
+    std::vector<Real> srcDLValue;            ///< scaled DL value passed to pvfmm
+    std::vector<Real> trgValue;              ///< trg value returned by pvfmm
+};
+
+/**
+ * @brief resident memory growth of this process while translation operators were initialized, in bytes
+ * concurrent initializations are counted once, allocations of other threads in the meantime are included
+ */
+std::size_t operatorResidentBytes();
+
+/**
+ * @brief peak resident memory of this process in bytes since resetPeakResident(), 0 if unknown
+ */
+std::size_t peakResidentBytes();
+
+/**
+ * @brief reset the peak resident memory to the current value, if the kernel allows it
+ * otherwise peakResidentBytes() is the peak since the process started
+ */
+void resetPeakResident();
+
 /**
  * @brief Run FMM for a chosen kernel
  * (1) accept only coordinates within [0,1) box
@@ -20,20 +84,28 @@ class FMMData {
   public:
     const stkfmm::KERNEL kernelChoice; ///< chosen kernel
     const stkfmm::PAXIS periodicity;   ///< chosen periodicity
+    const stkfmm::PRECISION precision; ///< working precision of tree, operators and kernels
     bool enableFF;                     ///< enable periodic Far-Field fix
 
     int kdimSL;  ///< Single Layer kernel dimension
     int kdimDL;  ///< Double Layer kernel dimension
     int kdimTrg; ///< Target kernel dimension
+    int nBatch;  ///< value sets stacked in each point, nBatchRHS for batched kernels, otherwise 1
 
     int multOrder; ///< multipole order
     int maxPts;    ///< max number of points per octant
 
+    bool costWeighted = false; ///< partition the tree by estimated work instead of point count
+    PerfCounters perf;         ///< accumulated wall time of each phase on this rank
+
     const pvfmm::Kernel<double> *kernelFunctionPtr; ///< pointer to kernel function
 
     std::vector<double> equivCoord; ///< periodicity L2T equivalent point coord
     std::vector<double> M2Ldata;    ///< periodicity M2L operator data
-    std::vector<double> M2Cdata;    ///< periodicity M2C operator data
+    std::shared_ptr<const OperatorMatrix> M2Cdata; ///< periodicity M2C operator data
+
+    std::vector<int> srcScaleExponent; ///< each SL source component scales as scaleFactor^exponent
+    std::vector<int> trgScaleExponent; ///< each target component scales as scaleFactor^exponent
 
     FMMData() = delete; ///< forbid default constructor
 
@@ -45,13 +117,17 @@ class FMMData {
 
     /**
      * @brief Construct a new FMMData object
+     * cheap, pvfmm operators are initialized by initialize(). collective
      *
      * @param kernelChoice_
      * @param periodicity_
      * @param multOrder_
      * @param maxPts_
+     * @param enableFF_
+     * @param precision_
      */
-    FMMData(KERNEL kernelChoice_, PAXIS periodicity_, int multOrder_, int maxPts_, bool enableFF_ = true);
+    FMMData(KERNEL kernelChoice_, PAXIS periodicity_, int multOrder_, int maxPts_, bool enableFF_ = true,
+            PRECISION precision_ = PRECISION::DOUBLE);
 
     /**
      * @brief Destroy the FMMData object
@@ -59,6 +135,37 @@ class FMMData {
      */
     ~FMMData();
 
+    /**
+     * @brief load periodic data and initialize pvfmm operators, collective
+     * called by the first setupTree(), a no-op if already initialized
+     *
+     */
+    void initialize();
+
+    /**
+     * @brief the part of initialize() that must not run concurrently with other FMMData, collective
+     * loads periodic data through the process-wide operator cache,
+     * and initializes the pvfmm kernel objects, some of which are shared between kernels
+     *
+     */
+    void prepare();
+
+    /**
+     * @brief if initialize() has been called
+     *
+     * @return true
+     * @return false
+     */
+    bool isInitialized() const { return initialized; }
+
+    /**
+     * @brief name of the M2M, M2L and L2L kernels, kernels with the same name share translation operators
+     * valid after prepare()
+     *
+     * @return std::string
+     */
+    std::string farFieldName() const;
+
     /**
      * @brief Set kernel function in pvfmm data structure
      *
@@ -79,6 +186,40 @@ class FMMData {
     void setupTree(const std::vector<double> &srcSLCoord, const std::vector<double> &srcDLCoord,
                    const std::vector<double> &trgCoord, const int ntreePts = 0, const double *treePtsPtr = nullptr);
 
+    /**
+     * @brief setup tree from coordinate arrays owned by the caller, e.g. a range of a larger array
+     *
+     * @param nSL single layer source number of points
+     * @param srcSLCoordPtr single layer source coordinate
+     * @param nDL double layer source number of points
+     * @param srcDLCoordPtr double layer source coordinate
+     * @param nTrg target number of points
+     * @param trgCoordPtr target coordinate
+     * @param ntreePts
+     * @param treePtsPtr
+     */
+    void setupTree(const int nSL, const double *srcSLCoordPtr, const int nDL, const double *srcDLCoordPtr,
+                   const int nTrg, const double *trgCoordPtr, const int ntreePts = 0,
+                   const double *treePtsPtr = nullptr);
+
+    /**
+     * @brief move the points of the tree to new coordinates, keeping the octree and its partition, collective
+     * the points must be in the same number and order on each rank as in setupTree().
+     * Only the ghost copies and interaction data are set up again
+     *
+     * @param nSL single layer source number of points
+     * @param srcSLCoordPtr single layer source coordinate
+     * @param nDL double layer source number of points
+     * @param srcDLCoordPtr double layer source coordinate
+     * @param nTrg target number of points
+     * @param trgCoordPtr target coordinate
+     * @param imbalanceThreshold max getImbalance() to keep the partition
+     * @return true if the tree is kept, false if a point left its leaf or the imbalance exceeds imbalanceThreshold,
+     * then the tree must be deleted and set up again
+     */
+    bool updateTree(const int nSL, const double *srcSLCoordPtr, const int nDL, const double *srcDLCoordPtr,
+                    const int nTrg, const double *trgCoordPtr, const double imbalanceThreshold);
+
     /**
      * @brief runFMM
      *
@@ -90,6 +231,27 @@ class FMMData {
     void evaluateFMM(std::vector<double> &srcSLValue, std::vector<double> &srcDLValue, std::vector<double> &trgValue,
                      const double scale);
 
+    /**
+     * @brief runFMM on caller-owned buffers
+     * sources are scaled while copied to the internal buffer pvfmm requires,
+     * and results are written to trgValuePtr without another intermediate copy.
+     * the arrays may hold nRHS interleaved value sets of the unbatched kernel, ordered as (point, set, component),
+     * then the nBatch sets starting at the pointers are evaluated
+     *
+     * @param nSL single layer source number of points
+     * @param srcSLValuePtr [in] single layer source value
+     * @param nDL double layer source number of points
+     * @param srcDLValuePtr [in] double layer source value, nullptr for zero
+     * @param nTrg target number of points
+     * @param trgValuePtr [out] target value
+     * @param scale
+     * @param mode overwrite or accumulate into trgValuePtr
+     * @param nRHS number of value sets in the arrays, at least nBatch
+     */
+    void evaluateFMM(const int nSL, const double *srcSLValuePtr, const int nDL, const double *srcDLValuePtr,
+                     const int nTrg, double *trgValuePtr, const double scale, const EVALMODE mode,
+                     const int nRHS = 1);
+
     /**
      * @brief directly evaluate kernel functions without FMM tree
      *
@@ -107,12 +269,31 @@ class FMMData {
                         double *srcValuePtr, //
                         const int nTrg, double *trgCoordPtr, double *trgValuePtr);
 
+    /**
+     * @brief directly evaluate a given kernel function without FMM tree
+     *
+     * @param kernelFunctionPtr the kernel function, not necessarily the one of any FMMData
+     * other parameters are the same as the member version
+     */
+    static void evaluateKernel(const pvfmm::Kernel<double> *kernelFunctionPtr, int nThreads, PPKERNEL chooseSD, //
+                               const int nSrc, double *srcCoordPtr,
+                               double *srcValuePtr, //
+                               const int nTrg, double *trgCoordPtr, double *trgValuePtr);
+
     /**
      * @brief delete the fmm tree
      *
      */
     void deleteTree();
 
+    /**
+     * @brief if the tree has been set up
+     *
+     * @return true
+     * @return false
+     */
+    bool hasTree() const;
+
     /**
      * @brief clear the FMM data
      *
@@ -127,50 +308,210 @@ class FMMData {
      */
     bool hasDL() const { return kernelFunctionPtr->dbl_layer_poten; }
 
+    /**
+     * @brief load imbalance of the tree, collective
+     * max over ranks / mean of the estimated work of the points in the leaves each rank owns
+     *
+     * @return 1 if balanced or no tree exists
+     */
+    double getImbalance();
+
+    /**
+     * @brief memory used by this kernel on this rank
+     *
+     * @return MemoryUsage
+     */
+    MemoryUsage getMemoryUsage() const;
+
+    /**
+     * @brief MPI communicator of the tree
+     *
+     * @return MPI_Comm
+     */
+    MPI_Comm getComm() const { return comm; }
+
+    /**
+     * @brief add the wall time since time to a phase of perf, and restart time
+     *
+     * @param phase
+     * @param time [in,out] MPI_Wtime() at the start of the phase
+     */
+    void tick(PHASE phase, double &time) {
+        const double now = MPI_Wtime();
+        perf.seconds[asInteger(phase)] += now - time;
+        time = now;
+    }
+
   private:
-    pvfmm::PtFMM<double> *matrixPtr;        ///< pvfmm PtFMM pointer
-    pvfmm::PtFMM_Tree<double> *treePtr;     ///< pvfmm PtFMM_Tree pointer
-    pvfmm::PtFMM_Data<double> *treeDataPtr; ///< pvfmm PtFMM_Data pointer
-    MPI_Comm comm;                          ///< MPI_comm communicator
+    FMMEngine<double> *engineDouble = nullptr; ///< pvfmm objects for PRECISION::DOUBLE
+    FMMEngine<float> *engineFloat = nullptr;   ///< pvfmm objects for PRECISION::FLOAT
+    int nSLTree = 0;                        ///< SL source number of points in the tree
+    int nDLTree = 0;                        ///< DL source number of points in the tree
+    int nTrgTree = 0;                       ///< target number of points in the tree
+    MPI_Comm comm;                          ///< MPI_comm communicator, a duplicate of MPI_COMM_WORLD
+    bool initialized = false;               ///< periodic data and pvfmm operators are loaded
 
     /**
-     * @brief scale SrcSl and SrcDL Values before FMM call
-     *  operate on srcSLValue and srcDLValue
+     * @brief call f with the engine of the chosen precision, no-op before initialize()
+     *
+     * @tparam F callable taking FMMEngine<float>& or FMMEngine<double>&
+     * @param f
+     */
+    template <class F>
+    void withEngine(F &&f) const {
+        if (engineFloat != nullptr)
+            f(*engineFloat);
+        else if (engineDouble != nullptr)
+            f(*engineDouble);
+    }
+
+    /**
+     * @brief initialize translation operators and periodic M2C in the engine
+     *
+     * @tparam Real
+     * @param engine
+     * @param kernel pvfmm kernel in precision Real
+     */
+    template <class Real>
+    void initEngine(FMMEngine<Real> &engine, const pvfmm::Kernel<Real> *kernel);
+
+    /**
+     * @brief Precomp file of the translation operators, collective
+     * in the STKFMM cache if STKFMM_CACHE_DIR is set, otherwise in $PVFMM_DIR
+     *
+     * @tparam Real
+     * @return <dir>/Precomp_<farFieldName()>_m<order>[_f].data
+     */
+    template <class Real>
+    std::string precompFile();
+
+    /**
+     * @brief build the tree in the engine, coordinates are converted to Real
+     *
+     */
+    template <class Real>
+    void setupTree(FMMEngine<Real> &engine, const int nSL, const double *srcSLCoordPtr, const int nDL,
+                   const double *srcDLCoordPtr, const int nTrg, const double *trgCoordPtr, const int ntreePts,
+                   const double *treePtsPtr);
+
+    /**
+     * @brief move the points of the tree in the engine, see updateTree()
+     *
+     */
+    template <class Real>
+    bool updateTree(FMMEngine<Real> &engine, const int nSL, const double *srcSLCoordPtr, const int nDL,
+                    const double *srcDLCoordPtr, const int nTrg, const double *trgCoordPtr,
+                    const double imbalanceThreshold);
+
+    /**
+     * @brief CostModel with the dimensions of this kernel
+     *
+     * @return CostModel
+     */
+    CostModel makeCostModel() const;
+
+    /**
+     * @brief tree points for costWeighted partitioning, all points repeated in proportion to their estimated work
+     * max_pts is scaled so that leaves hold about as many points as with the largest point set alone
+     *
+     */
+    template <class Real>
+    void weightedTreePoints(pvfmm::PtFMM_Data<Real> &treeData, const int nSL, const double *srcSLCoordPtr,
+                            const int nDL, const double *srcDLCoordPtr, const int nTrg, const double *trgCoordPtr);
+
+    /**
+     * @brief bytes of points, values and equivalent densities in the tree nodes
      *
-     * @param srcSLValue
-     * @param srcDLValue
-     * @param scaleFactor
      */
-    void scaleSrc(std::vector<double> &srcSLValue, std::vector<double> &srcDLValue, const double scaleFactor);
+    template <class Real>
+    std::size_t treeBytes(const FMMEngine<Real> &engine) const;
 
     /**
-     * @brief scale Trg Values after FMM call
-     *  operate on trgSLValue
+     * @brief imbalance of the tree in the engine, see getImbalance()
      *
-     * @param trgDLValue
+     */
+    template <class Real>
+    double imbalance(const FMMEngine<Real> &engine);
+
+    /**
+     * @brief copy scaled SrcSL and SrcDL Values to the engine work buffers
+     *
+     * @param engine
+     * @param nSL
+     * @param srcSLValuePtr
+     * @param nDL
+     * @param srcDLValuePtr nullptr for zero
      * @param scaleFactor
+     * @param nRHS number of interleaved value sets, as in evaluateFMM()
      */
-    void scaleTrg(std::vector<double> &trgDLValue, const double scaleFactor);
+    template <class Real>
+    void copyScaledSrc(FMMEngine<Real> &engine, const int nSL, const double *srcSLValuePtr, const int nDL,
+                       const double *srcDLValuePtr, const double scaleFactor, const int nRHS);
 
     /**
-     * @brief read the M2L Matrix from file
+     * @brief read a periodic operator from $PVFMM_DIR/pdata
+     * the binary file <dataName>.bin is mmap()ed if present, otherwise the text file <dataName> is parsed
      *
+     * @param kname name of the m2l kernel
+     * @param kDim kernel dimension of the m2l kernel
+     * @param type operator type, "M2C" or "M2L"
+     * @return the operator, column-major
      */
-    void readMat(const int kDim, const std::string &dataName, std::vector<double> &data);
+    std::shared_ptr<const OperatorMatrix> readMat(const std::string &kname, const int kDim, const std::string &type);
+
+    /**
+     * @brief generate a missing periodic operator and cache it in $PVFMM_DIR/pdata
+     * collective on comm, a no-op if the data exists or the library is built without GENERATE_M2C
+     *
+     * @param kname name of the m2l kernel
+     * @param kDim kernel dimension of the m2l kernel
+     * @param type operator type, only "M2C" can be generated
+     * @return the operator on rank 0 if it cannot be written to disk, nullptr otherwise
+     */
+    std::shared_ptr<const OperatorMatrix> generateMat(const std::string &kname, const int kDim,
+                                                      const std::string &type);
+
+    /**
+     * @brief generate or read the M2C operator of an m2l kernel through the operator cache, collective
+     *
+     * @param kname name of the m2l kernel
+     * @param kDim kernel dimension of the m2l kernel
+     * @return the operator, column-major
+     */
+    std::shared_ptr<const OperatorMatrix> loadM2C(const std::string &kname, const int kDim);
 
     /**
      * @brief setup this->M2Ldata, this->M2Cdata
+     * the M2C of a block diagonal m2l kernel is assembled from the M2C of its blocks
      *
      */
     void setupPeriodicData();
 
     /**
-     * @brief periodize the target values
+     * @brief periodic correction of the target values, the same for all targets
+     * zero unless the net flux of stokes_PVel kernels needs correction in PXYZ
      *
+     * @param engine
+     * @param trgShift [out] value added to each target component, length kdimTrg
+     */
+    template <class Real>
+    void periodicShift(const FMMEngine<Real> &engine, std::vector<double> &trgShift);
+
+    /**
+     * @brief periodize, scale back and write target values in one pass
+     *  driven by trgScaleExponent
      *
-     * @param trgValue
+     * @param engine
+     * @param nTrg target number of points
+     * @param trgValue [in] target value computed by pvfmm
+     * @param trgValuePtr [out] target value
+     * @param scale
+     * @param mode overwrite or accumulate into trgValuePtr
+     * @param nRHS number of interleaved value sets in trgValuePtr, as in evaluateFMM()
      */
-    void periodizeFMM(std::vector<double> &trgValue);
+    template <class Real>
+    void postProcess(const FMMEngine<Real> &engine, const int nTrg, const Real *trgValue, double *trgValuePtr,
+                     const double scale, const EVALMODE mode, const int nRHS);
 };
 
 } // namespace impl
@@ -0,0 +1,157 @@
+/**
+ * @file StokesLaplaceKernel.hpp
+ * @brief Stokeslet velocity and Laplace PGrad in one kernel
+ *
+ * Stk3DFMM evaluates Stokes and LapPGrad on the same points with this kernel when both are requested
+ * in one evaluateFMM() call. Both fields share one tree and one traversal.
+ *
+ * single layer source, 4 per point:  fx,fy,fz Stokes, q Laplace
+ * double layer source, 3 per point:  dx,dy,dz Laplace dipole
+ * target, 7 per point:               ux,uy,uz Stokes, p, grad p Laplace
+ * equivalent density, 4 per point:   Stokeslet fx,fy,fz, Laplace q
+ */
+#ifndef STOKESLAPLACEKERNEL_HPP_
+#define STOKESLAPLACEKERNEL_HPP_
+
+#include "LaplaceLayerKernel.hpp"
+
+namespace pvfmm {
+
+/**
+ * @brief Stokeslet velocity without the 1/(8 pi) factor, added to u[0..2]
+ *
+ */
+template <class VecType, int N>
+inline void stokesLaplaceVel(VecType (&u)[N], const VecType (&r)[3], const VecType &fx, const VecType &fy,
+                             const VecType &fz, const VecType &r2, const VecType &rinv3) {
+    VecType fdotr = fx * r[0] + fy * r[1] + fz * r[2];
+    u[0] += (r2 * fx + r[0] * fdotr) * rinv3;
+    u[1] += (r2 * fy + r[1] * fdotr) * rinv3;
+    u[2] += (r2 * fz + r[2] * fdotr) * rinv3;
+}
+
+/**********************************************************
+ *                                                        *
+ *  single layer / equivalent density -> equivalent, 4->4 *
+ *  Stokeslet velocity and Laplace potential              *
+ *                                                        *
+ **********************************************************/
+struct stokes_laplace_equiv : public GenericKernel<stokes_laplace_equiv> {
+    static const int FLOPS = 25;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[4], const VecType (&r)[3], const VecType (&f)[4], const void *ctx_ptr) {
+        VecType r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+        VecType rinv = sctl::approx_rsqrt<digits>(r2, r2 > VecType::Zero());
+        VecType rinv3 = rinv * rinv * rinv;
+        const VecType two = (typename VecType::ScalarType)(2.0);
+
+        // Laplace kernels scale as 1/(4 pi)
+        stokesLaplaceVel(u, r, f[0], f[1], f[2], r2, rinv3);
+        u[3] += two * f[3] * rinv;
+    }
+};
+
+/**********************************************************
+ *                                                        *
+ *  double layer -> equivalent density, 3 -> 4            *
+ *                                                        *
+ **********************************************************/
+struct stokes_laplace_dipole_equiv : public GenericKernel<stokes_laplace_dipole_equiv> {
+    static const int FLOPS = 20;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[4], const VecType (&r)[3], const VecType (&f)[3], const void *ctx_ptr) {
+        const VecType two = (typename VecType::ScalarType)(2.0);
+        VecType p[1] = {VecType::Zero()};
+        laplace_dipolep::uKerEval<VecType, digits>(p, r, f, ctx_ptr);
+
+        u[3] += two * p[0];
+    }
+};
+
+/**********************************************************
+ *                                                        *
+ *  single layer / equivalent density -> target, 4 -> 7   *
+ *                                                        *
+ **********************************************************/
+struct stokes_laplace_vpgrad : public GenericKernel<stokes_laplace_vpgrad> {
+    static const int FLOPS = 45;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[7], const VecType (&r)[3], const VecType (&f)[4], const void *ctx_ptr) {
+        VecType r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+        VecType rinv = sctl::approx_rsqrt<digits>(r2, r2 > VecType::Zero());
+        VecType rinv3 = rinv * rinv * rinv;
+        const VecType two = (typename VecType::ScalarType)(2.0);
+
+        stokesLaplaceVel(u, r, f[0], f[1], f[2], r2, rinv3);
+        VecType sv = two * f[3] * rinv3;
+        u[3] += sv * r2;
+        u[4] -= sv * r[0];
+        u[5] -= sv * r[1];
+        u[6] -= sv * r[2];
+    }
+};
+
+/**********************************************************
+ *                                                        *
+ *  double layer -> target, 3 -> 7                        *
+ *                                                        *
+ **********************************************************/
+struct stokes_laplace_dipole_vpgrad : public GenericKernel<stokes_laplace_dipole_vpgrad> {
+    static const int FLOPS = 30;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[7], const VecType (&r)[3], const VecType (&f)[3], const void *ctx_ptr) {
+        const VecType two = (typename VecType::ScalarType)(2.0);
+        VecType lap[4] = {VecType::Zero(), VecType::Zero(), VecType::Zero(), VecType::Zero()};
+        laplace_dipolepgrad::uKerEval<VecType, digits>(lap, r, f, ctx_ptr);
+
+        for (int i = 0; i < 4; i++)
+            u[3 + i] += two * lap[i];
+    }
+};
+
+/**
+ * @brief Stokes and Laplace fused kernel
+ *
+ * @tparam T float or double
+ */
+template <class T>
+struct StokesLaplaceKernel {
+    inline static const Kernel<T> &VelPGrad(); ///< SL 4 + DL 3 -> 7, see the file comment
+};
+
+template <class T>
+inline const Kernel<T> &StokesLaplaceKernel<T>::VelPGrad() {
+    // the periodic M2C of stokes_laplace is assembled from stokes_vel and laplace, see FMMData::setupPeriodicData()
+    static Kernel<T> equiv_ker =
+        BuildKernel<T, stokes_laplace_equiv::Eval<T>, stokes_laplace_dipole_equiv::Eval<T>>(
+            "stokes_laplace", 3, std::pair<int, int>(4, 4));
+    equiv_ker.surf_dim = 3;
+
+    static Kernel<T> fused_ker =
+        BuildKernel<T, stokes_laplace_vpgrad::Eval<T>, stokes_laplace_dipole_vpgrad::Eval<T>>(
+            "stokes_laplace_VelPGrad", 3, std::pair<int, int>(4, 7), &equiv_ker, &equiv_ker, NULL, &equiv_ker,
+            &equiv_ker, NULL, &equiv_ker, NULL);
+    fused_ker.surf_dim = 3;
+
+    return fused_ker;
+}
+
+} // namespace pvfmm
+
+#endif
@@ -20,6 +20,66 @@
  */
 namespace pvfmm {
 
+/*********************************************************
+ *                                                        *
+ *   Stokes P Vel Traction kernel, source: 4, target: 13  *
+ *                                                        *
+ **********************************************************/
+struct stokes_pveltraction : public GenericKernel<stokes_pveltraction> {
+    static const int FLOPS = 40;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[13], const VecType (&r)[3], const VecType (&f)[4], const void *ctx_ptr) {
+        // stokes_traction scales as -3/(4 pi)
+        const VecType six = (typename VecType::ScalarType)(6.0);
+        VecType pvel[4], traction[9];
+        for (int i = 0; i < 4; i++)
+            pvel[i] = VecType::Zero();
+        for (int i = 0; i < 9; i++)
+            traction[i] = VecType::Zero();
+        stokes_pvel::uKerEval<VecType, digits>(pvel, r, f, ctx_ptr);
+        stokes_traction::uKerEval<VecType, digits>(traction, r, f, ctx_ptr);
+
+        for (int i = 0; i < 4; i++)
+            u[i] += pvel[i];
+        for (int i = 0; i < 9; i++)
+            u[4 + i] -= six * traction[i];
+    }
+};
+
+/*********************************************************
+ *                                                        *
+ *   Stokes Double P Vel Traction, source: 9, target: 13  *
+ *                                                        *
+ **********************************************************/
+struct stokes_doublepveltraction : public GenericKernel<stokes_doublepveltraction> {
+    static const int FLOPS = 60;
+    template <class Real>
+    static Real ScaleFactor() {
+        return 1.0 / (8.0 * sctl::const_pi<Real>());
+    }
+    template <class VecType, int digits>
+    static void uKerEval(VecType (&u)[13], const VecType (&r)[3], const VecType (&f)[9], const void *ctx_ptr) {
+        // stokes_doubletraction scales as -3/(8 pi)
+        const VecType three = (typename VecType::ScalarType)(3.0);
+        VecType pvel[4], traction[9];
+        for (int i = 0; i < 4; i++)
+            pvel[i] = VecType::Zero();
+        for (int i = 0; i < 9; i++)
+            traction[i] = VecType::Zero();
+        stokes_doublepvel::uKerEval<VecType, digits>(pvel, r, f, ctx_ptr);
+        stokes_doubletraction::uKerEval<VecType, digits>(traction, r, f, ctx_ptr);
+
+        for (int i = 0; i < 4; i++)
+            u[i] += pvel[i];
+        for (int i = 0; i < 9; i++)
+            u[4 + i] -= three * traction[i];
+    }
+};
+
 /**
  * @brief Stokes Layer Kernels
  *
@@ -32,6 +92,7 @@ struct StokesLayerKernel {
     inline static const Kernel<T> &PVelGrad();      ///< SL+DL -> PVelGrad
     inline static const Kernel<T> &PVelLaplacian(); ///< SL+DL -> PVelLaplacian
     inline static const Kernel<T> &Traction();      ///< SL+DL -> Traction
+    inline static const Kernel<T> &PVelTraction();  ///< SL+DL -> PVel and Traction, 4+9 per target
 };
 
 
@@ -51,41 +112,50 @@ inline const Kernel<T> &StokesLayerKernel<T>::PVel() {
 
 template <class T>
 inline const Kernel<T> &StokesLayerKernel<T>::PVelGrad() {
-    static Kernel<T> stokes_pker = BuildKernel<T, stokes_pvel::Eval<T>, stokes_doublepvel::Eval<T>>(
-        "stokes_PVel", 3, std::pair<int, int>(4, 4));
-    stokes_pker.surf_dim = 9;
+    // share the far field kernel with PVel
+    const Kernel<T> *stokes_pker = &PVel();
     static Kernel<T> stokes_pgker = BuildKernel<T, stokes_pvelgrad::Eval<T>, stokes_doublepvelgrad::Eval<T>>(
-        "stokes_PVelGrad", 3, std::pair<int, int>(4, 16), &stokes_pker, &stokes_pker, NULL, &stokes_pker, &stokes_pker,
-        NULL, &stokes_pker, NULL);
+        "stokes_PVelGrad", 3, std::pair<int, int>(4, 16), stokes_pker, stokes_pker, NULL, stokes_pker, stokes_pker,
+        NULL, stokes_pker, NULL);
     stokes_pgker.surf_dim = 9;
     return stokes_pgker;
 }
 
 template <class T>
 inline const Kernel<T> &StokesLayerKernel<T>::PVelLaplacian() {
-    static Kernel<T> stokes_pker = BuildKernel<T, stokes_pvel::Eval<T>, stokes_doublepvel::Eval<T>>(
-        "stokes_PVel", 3, std::pair<int, int>(4, 4));
-    stokes_pker.surf_dim = 9;
+    // share the far field kernel with PVel
+    const Kernel<T> *stokes_pker = &PVel();
     static Kernel<T> stokes_pgker =
         BuildKernel<T, stokes_pvellaplacian::Eval<T>, stokes_doublelaplacian::Eval<T>>(
-            "stokes_PVelLaplacian", 3, std::pair<int, int>(4, 7), &stokes_pker, &stokes_pker, NULL, &stokes_pker,
-            &stokes_pker, NULL, &stokes_pker, NULL);
+            "stokes_PVelLaplacian", 3, std::pair<int, int>(4, 7), stokes_pker, stokes_pker, NULL, stokes_pker,
+            stokes_pker, NULL, stokes_pker, NULL);
     stokes_pgker.surf_dim = 9;
     return stokes_pgker;
 }
 
 template <class T>
 inline const Kernel<T> &StokesLayerKernel<T>::Traction() {
-    static Kernel<T> stokes_pker = BuildKernel<T, stokes_pvel::Eval<T>, stokes_doublepvel::Eval<T>>(
-        "stokes_PVel", 3, std::pair<int, int>(4, 4));
-    stokes_pker.surf_dim = 9;
+    // share the far field kernel with PVel
+    const Kernel<T> *stokes_pker = &PVel();
     static Kernel<T> stokes_pgker =
         BuildKernel<T, stokes_traction::Eval<T>, stokes_doubletraction::Eval<T>>(
-            "stokes_Traction", 3, std::pair<int, int>(4, 9), &stokes_pker, &stokes_pker, NULL, &stokes_pker,
-            &stokes_pker, NULL, &stokes_pker, NULL);
+            "stokes_Traction", 3, std::pair<int, int>(4, 9), stokes_pker, stokes_pker, NULL, stokes_pker,
+            stokes_pker, NULL, stokes_pker, NULL);
     stokes_pgker.surf_dim = 9;
     return stokes_pgker;
 }
+
+template <class T>
+inline const Kernel<T> &StokesLayerKernel<T>::PVelTraction() {
+    // share the far field kernel with PVel
+    const Kernel<T> *stokes_pker = &PVel();
+    static Kernel<T> stokes_ptker =
+        BuildKernel<T, stokes_pveltraction::Eval<T>, stokes_doublepveltraction::Eval<T>>(
+            "stokes_PVelTraction", 3, std::pair<int, int>(4, 13), stokes_pker, stokes_pker, NULL, stokes_pker,
+            stokes_pker, NULL, stokes_pker, NULL);
+    stokes_ptker.surf_dim = 9;
+    return stokes_ptker;
+}
 } // namespace pvfmm
 
 #endif
@@ -0,0 +1,71 @@
+#ifndef STKFMM_TASKQUEUE_HPP_
+#define STKFMM_TASKQUEUE_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace stkfmm {
+
+namespace impl {
+
+/**
+ * @brief FIFO queue of FMM tasks run by one dedicated worker thread
+ * (1) tasks run in submission order, so MPI collectives inside them are ordered the same way on all ranks
+ *     as long as all ranks submit in the same order
+ * (2) the worker runs with its own number of OpenMP threads, so that several workers and the calling thread
+ *     together do not oversubscribe the cores
+ * (3) tasks run immediately on the calling thread unless MPI provides MPI_THREAD_MULTIPLE,
+ *     because the worker and the calling thread may call MPI at the same time
+ * The destructor waits for pending tasks and joins the worker.
+ */
+class TaskQueue {
+  public:
+    /**
+     * @brief Construct a new TaskQueue, the worker is started if threaded()
+     *
+     * @param nThreads number of OpenMP threads of the worker
+     */
+    explicit TaskQueue(int nThreads);
+
+    ~TaskQueue();
+
+    TaskQueue(const TaskQueue &) = delete;
+    TaskQueue &operator=(const TaskQueue &) = delete;
+
+    /**
+     * @brief append a task to the queue
+     *
+     * @param task
+     * @return std::future<void> ready when the task is finished, rethrows exceptions from the task
+     */
+    std::future<void> submit(std::function<void()> task);
+
+    /**
+     * @brief if MPI provides MPI_THREAD_MULTIPLE, prints a notice on rank 0 the first time it is not
+     *
+     * @return true if tasks run on the worker thread
+     */
+    static bool threaded();
+
+  private:
+    const int nThreads;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<std::packaged_task<void()>> tasks;
+    std::thread worker;
+    bool stop = false;
+
+    /**
+     * @brief the worker loop
+     *
+     */
+    void run();
+};
+
+} // namespace impl
+} // namespace stkfmm
+#endif
@@ -0,0 +1,51 @@
+#include "STKFMM/CostModel.hpp"
+
+namespace stkfmm {
+namespace impl {
+
+CostModel::CostModel(int kdimSL_, int kdimDL_, int kdimTrg_, int kdimM2L_, int multOrder_, int maxPts_)
+    : kdimM2L(kdimM2L_), maxPts(std::max(maxPts_, 1)) {
+    kdim[SL] = kdimSL_;
+    kdim[DL] = kdimDL_;
+    kdim[TRG] = kdimTrg_;
+    nEquiv = 6 * (multOrder_ - 1) * (multOrder_ - 1) + 2;
+    cellCount.assign(3 * nGrid * nGrid * nGrid, 0.0);
+}
+
+void CostModel::reduce(MPI_Comm comm) {
+    MPI_Allreduce(MPI_IN_PLACE, cellCount.data(), cellCount.size(), MPI_DOUBLE, MPI_SUM, comm);
+
+    // M2L with the 189 boxes in the interaction list, shared by the points of a full leaf
+    const double farLeaf = 189.0 * nEquiv * kdimM2L;
+    cellWeight.assign(cellCount.size(), 0.0);
+
+#pragma omp parallel for
+    for (int cell = 0; cell < nGrid * nGrid * nGrid; cell++) {
+        const int ix = cell % nGrid;
+        const int iy = (cell / nGrid) % nGrid;
+        const int iz = cell / (nGrid * nGrid);
+
+        // the near field of a target covers about 27 leaves of maxPts points,
+        // with the same mix of source and target points as the neighboring cells
+        double points = 0;
+        double srcDim = 0;
+        for (int z = std::max(iz - 1, 0); z <= std::min(iz + 1, nGrid - 1); z++) {
+            for (int y = std::max(iy - 1, 0); y <= std::min(iy + 1, nGrid - 1); y++) {
+                for (int x = std::max(ix - 1, 0); x <= std::min(ix + 1, nGrid - 1); x++) {
+                    const double *count = cellCount.data() + 3 * ((z * nGrid + y) * nGrid + x);
+                    points += count[SL] + count[DL] + count[TRG];
+                    srcDim += count[SL] * kdim[SL] + count[DL] * kdim[DL];
+                }
+            }
+        }
+        const double nearPairs = points > 0 ? 27.0 * maxPts * srcDim / points : 0;
+
+        double *weight = cellWeight.data() + 3 * cell;
+        weight[SL] = kdim[SL] * nEquiv + farLeaf / maxPts;
+        weight[DL] = kdim[DL] * nEquiv + farLeaf / maxPts;
+        weight[TRG] = kdim[TRG] * (nEquiv + nearPairs) + farLeaf / maxPts;
+    }
+}
+
+} // namespace impl
+} // namespace stkfmm
@@ -1,19 +1,214 @@
 #include "STKFMM/STKFMM_impl.hpp"
+#include "STKFMM/MaxPtsTuner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <type_traits>
+
+#ifdef STKFMM_GENERATE_M2C
+#include "M2CGenerator.hpp"
+#endif
 
 namespace stkfmm {
 namespace impl {
 
+/**
+ * @brief resident memory of this process in bytes, 0 if unknown
+ */
+static std::size_t residentBytes() {
+    long pages = 0, resident = 0;
+    FILE *fin = fopen("/proc/self/statm", "r");
+    if (fin == nullptr)
+        return 0;
+    if (fscanf(fin, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+    fclose(fin);
+    return std::size_t(resident) * sysconf(_SC_PAGESIZE);
+}
+
+std::size_t peakResidentBytes() {
+    std::ifstream fin("/proc/self/status");
+    std::string line;
+    while (std::getline(fin, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return std::size_t(atol(line.c_str() + 6)) * 1024;
+    }
+    return 0;
+}
+
+void resetPeakResident() {
+    FILE *fout = fopen("/proc/self/clear_refs", "w");
+    if (fout != nullptr) {
+        fputs("5", fout);
+        fclose(fout);
+    }
+}
+
+static std::mutex operatorResidentMutex;
+static int operatorInitCount = 0;             // initializations in progress
+static std::size_t operatorResidentStart = 0; // resident memory when the first of them started
+static std::size_t operatorResidentTotal = 0;
+
+std::size_t operatorResidentBytes() {
+    std::lock_guard<std::mutex> lock(operatorResidentMutex);
+    return operatorResidentTotal;
+}
+
 void FMMData::setKernel() {
-    matrixPtr->Initialize(multOrder, comm, kernelFunctionPtr);
-    kdimSL = kernelFunctionPtr->k_s2t->ker_dim[0];
-    kdimTrg = kernelFunctionPtr->k_s2t->ker_dim[1];
-    kdimDL = kernelFunctionPtr->surf_dim;
+    // measured from the first start to the last end of overlapping initializations
+    {
+        std::lock_guard<std::mutex> lock(operatorResidentMutex);
+        if (operatorInitCount++ == 0)
+            operatorResidentStart = residentBytes();
+    }
+    if (precision == PRECISION::FLOAT) {
+        engineFloat = new FMMEngine<float>();
+        initEngine(*engineFloat, kernelMapFloat.at(kernelChoice));
+    } else {
+        engineDouble = new FMMEngine<double>();
+        initEngine(*engineDouble, kernelFunctionPtr);
+    }
+    std::lock_guard<std::mutex> lock(operatorResidentMutex);
+    if (--operatorInitCount == 0) {
+        const std::size_t residentEnd = residentBytes();
+        if (residentEnd > operatorResidentStart)
+            operatorResidentTotal += residentEnd - operatorResidentStart;
+    }
+}
+
+static std::mutex precompMutex;
+
+/**
+ * @brief translation operators initialized in this process, by Precomp file
+ */
+template <class Real>
+static std::map<std::string, std::weak_ptr<pvfmm::PrecompMat<Real>>> &precompRegistry() {
+    static std::map<std::string, std::weak_ptr<pvfmm::PrecompMat<Real>>> registry;
+    return registry;
+}
+
+template <class Real>
+PrecompFMM<Real>::~PrecompFMM() {
+    // owned by shared, pvfmm must not delete it
+    if (shared)
+        this->mat = nullptr;
+}
+
+template <class Real>
+void PrecompFMM<Real>::Initialize(int multOrder, MPI_Comm comm, const pvfmm::Kernel<Real> *kernel,
+                                  const std::string &file) {
+    std::shared_ptr<pvfmm::PrecompMat<Real>> leader;
+    {
+        std::lock_guard<std::mutex> lock(precompMutex);
+        auto it = precompRegistry<Real>().find(file);
+        if (it != precompRegistry<Real>().end())
+            leader = it->second.lock();
+    }
+
+    // adopt only if every rank has a leader, pvfmm computes the operators collectively
+    int adopt = (leader != nullptr);
+    MPI_Allreduce(MPI_IN_PLACE, &adopt, 1, MPI_INT, MPI_LAND, comm);
+    this->mat_fname = file;
+    if (adopt) {
+        // the same operators as an earlier kernel, keep one copy and compute nothing.
+        // the rest of what FMM_Pts::Initialize sets, pvfmm only reads the PrecompMat afterwards
+        kernel->Initialize();
+        this->kernel = kernel;
+        this->multipole_order = multOrder;
+        this->comm = comm;
+        this->mat = leader.get();
+        this->interac_list.Initialize(3, this->mat);
+        shared = leader;
+        return;
+    }
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    const bool missing = (rank == 0) && access(file.c_str(), R_OK) != 0;
+
+    // with mat_fname set, pvfmm loads the file if present but never saves it
+    pvfmm::PtFMM<Real>::Initialize(multOrder, comm, kernel);
+    shared.reset(this->mat);
+    {
+        std::lock_guard<std::mutex> lock(precompMutex);
+        precompRegistry<Real>()[file] = shared;
+    }
+    if (!missing)
+        return;
+
+    // write and rename, so other processes never load a partial file
+    const std::string tmp = file + ".tmp" + std::to_string(getpid());
+    if (this->mat->Save2File(tmp.c_str(), true) == 0 && rename(tmp.c_str(), file.c_str()) == 0) {
+        if (stkfmm::verbose)
+            std::cout << "translation operators saved to " << file << std::endl;
+    } else {
+        if (stkfmm::verbose)
+            std::cout << "cannot write " << file << ", translation operators not cached" << std::endl;
+        remove(tmp.c_str());
+    }
+}
+
+template class PrecompFMM<float>;
+template class PrecompFMM<double>;
+
+std::string FMMData::farFieldName() const {
+    // pvfmm fills in missing sub-kernels with the kernel itself in Kernel::Initialize()
+    const pvfmm::Kernel<double> *ker = kernelFunctionPtr;
+    const std::string m2m = ker->k_m2m ? ker->k_m2m->ker_name : ker->ker_name;
+    const std::string m2l = ker->k_m2l ? ker->k_m2l->ker_name : ker->ker_name;
+    const std::string l2l = ker->k_l2l ? ker->k_l2l->ker_name : ker->ker_name;
+    std::string name = m2m;
+    if (m2l != m2m || l2l != m2m)
+        name += "_" + m2l + "_" + l2l;
+    // pvfmm stores the operators of every level unless the kernel is scale invariant
+    if (!ker->scale_invar)
+        name += "_ns";
+    return name;
+}
+
+template <class Real>
+std::string FMMData::precompFile() {
+    std::string dir = OperatorCache::translationCacheDir(comm);
+    if (dir.empty()) {
+        char *pvfmm_dir = getenv("PVFMM_DIR");
+        dir = pvfmm_dir == nullptr ? std::string(".") : std::string(pvfmm_dir);
+    }
+    // the pvfmm naming convention, with the far-field kernels instead of the kernel
+    return dir + "/Precomp_" + farFieldName() + "_m" + std::to_string(multOrder) +
+           (std::is_same<Real, float>::value ? "_f" : "") + ".data";
 }
 
-void FMMData::readMat(const int kDim, const std::string &dataName, std::vector<double> &data) {
+template <class Real>
+void FMMData::initEngine(FMMEngine<Real> &engine, const pvfmm::Kernel<Real> *kernel) {
+    // pvfmm loads its translation operators from the Precomp file, and computes them if missing.
+    // kernels with the same far-field kernels share one copy
+    engine.matrix.Initialize(multOrder, comm, kernel, precompFile<Real>());
+
+    if (periodicity == PAXIS::NONE)
+        return;
+    if (!enableFF) {
+        printf("PBC FF disabled\n");
+        engine.matrix.SetM2C(nullptr);
+    } else if (std::is_same<Real, double>::value) {
+        // pvfmm only reads M2C, the mapped pages are read-only
+        engine.matrix.SetM2C(reinterpret_cast<Real *>(const_cast<double *>(M2Cdata->data())));
+    } else {
+        // the shared double copy stays in the cache, each float engine keeps a converted copy
+        engine.M2C.assign(M2Cdata->data(), M2Cdata->data() + M2Cdata->size());
+        engine.matrix.SetM2C(engine.M2C.data());
+    }
+}
+
+std::shared_ptr<const OperatorMatrix> FMMData::readMat(const std::string &kname, const int kDim,
+                                                       const std::string &type) {
     // int size = kDim * (6 * (multOrder - 1) * (multOrder - 1) + 2);
-    int size = kDim * equivCoord.size() / 3;
-    data.resize(size * size);
+    const int size = kDim * equivCoord.size() / 3;
+    const int pbc = static_cast<int>(periodicity);
+    const std::string dataName = operatorName(type, kname, pbc, multOrder);
 
     char *pvfmm_dir = getenv("PVFMM_DIR");
     if (pvfmm_dir == nullptr) {
@@ -24,51 +219,237 @@ void FMMData::readMat(const int kDim, const std::string &dataName, std::vector<d
     std::string file = std::string(pvfmm_dir) + std::string("/pdata/") + dataName;
 
     std::cout << dataName << " " << size << std::endl;
-    FILE *fin = fopen(file.c_str(), "r");
-    if (fin == nullptr) {
+
+    // binary format, mapped in place. The checksum scan reads the whole file, so it is opt-in
+    char *verify = getenv("STKFMM_VERIFY_OPERATORS");
+    const bool verifyChecksum = verify != nullptr && std::string(verify) != "0";
+    auto mat = std::make_shared<OperatorMatrix>();
+    if (mat->map(file + ".bin", type, kname, pbc, multOrder, size, verifyChecksum)) {
+        return mat;
+    }
+
+    // legacy text format
+    std::vector<double> data;
+    if (!readTextOperator(file, size, data)) {
         std::cout << "data " << dataName << " not found" << std::endl;
         exit(1);
     }
-    for (int i = 0; i < size; i++) {
-        for (int j = 0; j < size; j++) {
-            int iread, jread;
-            double fread;
-            fscanf(fin, "%d %d %lf\n", &iread, &jread, &fread);
-            if (i != iread || j != jread) {
-                printf("read ij error %d %d\n", i, j);
-                exit(1);
-            }
-            data[j * size + i] = fread; // convert to col major
+    if (stkfmm::verbose)
+        std::cout << "convert " << file << " with M2LConvert for faster loading" << std::endl;
+
+    return std::make_shared<OperatorMatrix>(size, size, std::move(data));
+}
+
+std::shared_ptr<const OperatorMatrix> FMMData::generateMat(const std::string &kname, const int kDim,
+                                                           const std::string &type) {
+    const int pbc = static_cast<int>(periodicity);
+    const std::string dataName = operatorName(type, kname, pbc, multOrder);
+
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    char *pvfmm_dir = getenv("PVFMM_DIR");
+    const std::string dir = pvfmm_dir == nullptr ? std::string() : std::string(pvfmm_dir) + std::string("/pdata");
+    const std::string file = dir + "/" + dataName;
+
+    int missing = 0;
+    if (rank == 0) {
+        missing = dir.empty() || (access((file + ".bin").c_str(), R_OK) != 0 && access(file.c_str(), R_OK) != 0);
+    }
+    MPI_Bcast(&missing, 1, MPI_INT, 0, comm);
+    if (!missing) {
+        return nullptr;
+    }
+
+#ifdef STKFMM_GENERATE_M2C
+    if (type != "M2C") {
+        return nullptr;
+    }
+    const int size = kDim * equivCoord.size() / 3;
+    if (rank == 0)
+        std::cout << "data " << dataName << " not found, generating" << std::endl;
+    const double startTime = MPI_Wtime();
+    std::vector<double> data;
+    if (!generateM2C(kname, pbc, multOrder, comm, data)) {
+        if (rank == 0)
+            std::cout << "cannot generate " << dataName << std::endl;
+        exit(1);
+    }
+
+    // rank 0 holds the result, cache it for later runs
+    int cached = 0;
+    if (rank == 0) {
+        std::cout << dataName << " generated in " << MPI_Wtime() - startTime << " s" << std::endl;
+        if (!dir.empty()) {
+            mkdir(dir.c_str(), 0755);
+            cached = writeOperator(file + ".bin", type, kname, pbc, multOrder, size, size, data.data());
         }
     }
+    MPI_Bcast(&cached, 1, MPI_INT, 0, comm);
+    if (cached) {
+        // read back through the usual path
+        return nullptr;
+    }
+    // not writable, rank 0 serves it from memory
+    return rank == 0 ? std::make_shared<OperatorMatrix>(size, size, std::move(data)) : nullptr;
+#else
+    return nullptr;
+#endif
+}
 
-    fclose(fin);
+std::shared_ptr<const OperatorMatrix> FMMData::loadM2C(const std::string &kname, const int kDim) {
+    const int pbc = static_cast<int>(periodicity);
+
+    // read M2C data, shared by all kernels with the same m2l kernel and all ranks on this node.
+    // on a cache miss, generate it first if the data does not exist
+    const std::string dataName = operatorName("M2C", kname, pbc, multOrder);
+    std::shared_ptr<const OperatorMatrix> generated;
+    return OperatorCache::get(
+        dataName, comm, [&]() { return generated ? generated : readMat(kname, kDim, "M2C"); },
+        [&]() {
+            // a generated operator that cannot be written is only on rank 0, the node leaders cannot read it
+            generated = generateMat(kname, kDim, "M2C");
+            int inMemory = (generated != nullptr);
+            MPI_Bcast(&inMemory, 1, MPI_INT, 0, comm);
+            return inMemory != 0;
+        });
 }
 
+/**
+ * @brief m2l kernels made of other m2l kernels along the diagonal, (name, kernel dimension) of each block
+ */
+static const std::unordered_map<std::string, std::vector<std::pair<std::string, int>>> m2lBlockTable = {
+    {"rpy_wall", {{"stokes_vel", 3}, {"laplace", 1}, {"laplace", 1}}}, // RPYWallKernel
+    {"stokes_laplace", {{"stokes_vel", 3}, {"laplace", 1}}},            // StokesLaplaceKernel
+    // BatchKernel, one block per value set
+    {"stokes_vel_x4", {{"stokes_vel", 3}, {"stokes_vel", 3}, {"stokes_vel", 3}, {"stokes_vel", 3}}},
+    {"laplace_x4", {{"laplace", 1}, {"laplace", 1}, {"laplace", 1}, {"laplace", 1}}},
+};
+
 void FMMData::setupPeriodicData() {
-    int pbc = static_cast<int>(periodicity);
-    std::string kname = kernelFunctionPtr->k_m2l->ker_name;
-    int kdim = kernelFunctionPtr->k_m2l->ker_dim[0];
+    const int pbc = static_cast<int>(periodicity);
+    const std::string kname = kernelFunctionPtr->k_m2l->ker_name;
+    const int kdim = kernelFunctionPtr->k_m2l->ker_dim[0];
+
+    auto blocks = m2lBlockTable.find(kname);
+    if (blocks == m2lBlockTable.end()) {
+        this->M2Cdata = loadM2C(kname, kdim);
+        return;
+    }
 
-    // read M2C data
-    std::string dataName = "M2C_" + kname + "_" + std::to_string(pbc) + "D3D_p" + std::to_string(multOrder);
-    readMat(kdim, dataName, this->M2Cdata);
+    // on a cache miss, the M2C of each block, then assemble on the reading rank(s)
+    std::vector<std::shared_ptr<const OperatorMatrix>> blockM2C;
+    auto loadBlocks = [&]() {
+        for (const auto &block : blocks->second) {
+            blockM2C.push_back(loadM2C(block.first, block.second));
+        }
+        return false;
+    };
+    const std::string dataName = operatorName("M2C", kname, pbc, multOrder);
+    this->M2Cdata = OperatorCache::get(dataName, comm, [&]() {
+        // entry (kdim * check + a, kdim * equiv + b) of the block at offset, column-major
+        const size_t equivN = equivCoord.size() / 3;
+        const size_t size = kdim * equivN;
+        std::vector<double> data(size * size, 0.0);
+        int offset = 0;
+        for (size_t k = 0; k < blockM2C.size(); k++) {
+            const int bdim = blocks->second[k].second;
+            const double *src = blockM2C[k]->data();
+            const size_t bsize = bdim * equivN;
+#pragma omp parallel for
+            for (size_t j = 0; j < bsize; j++) {
+                const size_t col = kdim * (j / bdim) + offset + j % bdim;
+                for (size_t i = 0; i < bsize; i++) {
+                    data[col * size + kdim * (i / bdim) + offset + i % bdim] = src[j * bsize + i];
+                }
+            }
+            offset += bdim;
+        }
+        return std::make_shared<OperatorMatrix>(size, size, std::move(data));
+    }, loadBlocks);
 }
 
+/**
+ * @brief power of scaleFactor applied to each SL source component before FMM in the [0,1) box
+ * DL sources always scale as scaleFactor. batched kernels repeat the entry of their unbatched kernel
+ */
+static const std::unordered_map<KERNEL, std::vector<int>> srcScaleExponentTable = {
+    {KERNEL::LapPGrad, {0}},                              // q
+    {KERNEL::LapPGradGrad, {0}},                          // q
+    {KERNEL::LapQPGradGrad, {0, 0, 0, 0, 0, 0, 0, 0, 0}}, // Q
+    {KERNEL::Stokes, {0, 0, 0}},                          // f
+    {KERNEL::RPY, {0, 0, 0, 1}},                          // f, b
+    {KERNEL::StokesRegVel, {0, 0, 0, 1}},                 // f, epsilon
+    {KERNEL::StokesRegVelOmega, {0, 0, 0, 1, 1, 1, 1}},   // f, torque, epsilon
+    {KERNEL::PVel, {0, 0, 0, 1}},                         // f, trace of DL
+    {KERNEL::PVelGrad, {0, 0, 0, 1}},                     // f, trace of DL
+    {KERNEL::PVelLaplacian, {0, 0, 0, 1}},                // f, trace of DL
+    {KERNEL::Traction, {0, 0, 0, 1}},                     // f, trace of DL
+    // f, b, q1, d1, Q1, q2, d2
+    {KERNEL::RPYWall, {0, 0, 0, 1, 0, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 1, 1}},
+    {KERNEL::StokesLapPGrad, {0, 0, 0, 0}}, // f, q
+    {KERNEL::PVelTraction, {0, 0, 0, 1}},   // f, trace of DL
+};
+
+/**
+ * @brief power of scaleFactor applied to each target component after FMM in the [0,1) box
+ * a component decaying as 1/r^k scales as scaleFactor^k
+ */
+static const std::unordered_map<KERNEL, std::vector<int>> trgScaleExponentTable = {
+    {KERNEL::LapPGrad, {1, 2, 2, 2}},                                     // p, grad p
+    {KERNEL::LapPGradGrad, {1, 2, 2, 2, 3, 3, 3, 3, 3, 3}},               // p, grad p, grad grad p
+    {KERNEL::LapQPGradGrad, {3, 4, 4, 4, 5, 5, 5, 5, 5, 5}},              // p, grad p, grad grad p
+    {KERNEL::Stokes, {1, 1, 1}},                                          // vel
+    {KERNEL::RPY, {1, 1, 1, 3, 3, 3}},                                    // vel, laplacian vel
+    {KERNEL::StokesRegVel, {1, 1, 1}},                                    // vel
+    {KERNEL::StokesRegVelOmega, {1, 1, 1, 2, 2, 2}},                      // vel, omega
+    {KERNEL::PVel, {2, 1, 1, 1}},                                         // p, vel
+    {KERNEL::PVelGrad, {2, 1, 1, 1, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2}}, // p, vel, grad p, grad vel
+    {KERNEL::PVelLaplacian, {2, 1, 1, 1, 3, 3, 3}},                       // p, vel, laplacian vel
+    {KERNEL::Traction, {2, 2, 2, 2, 2, 2, 2, 2, 2}},                      // traction
+    // vel, laplacian vel, Laplace S p, grad p, grad grad p, Laplace SZ p, grad p
+    {KERNEL::RPYWall, {1, 1, 1, 3, 3, 3, 1, 2, 2, 2, 3, 3, 3, 3, 3, 3, 1, 2, 2, 2}},
+    {KERNEL::StokesLapPGrad, {1, 1, 1, 1, 2, 2, 2}},                   // vel, p, grad p
+    {KERNEL::PVelTraction, {2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2}}, // p, vel, traction
+};
+
 // constructor
-FMMData::FMMData(KERNEL kernelChoice_, PAXIS periodicity_, int multOrder_, int maxPts_, bool enableFF_)
-    : kernelChoice(kernelChoice_), periodicity(periodicity_), multOrder(multOrder_), maxPts(maxPts_), treePtr(nullptr),
-      matrixPtr(nullptr), treeDataPtr(nullptr), enableFF(enableFF_) {
+FMMData::FMMData(KERNEL kernelChoice_, PAXIS periodicity_, int multOrder_, int maxPts_, bool enableFF_,
+                 PRECISION precision_)
+    : kernelChoice(kernelChoice_), periodicity(periodicity_), precision(precision_), enableFF(enableFF_),
+      multOrder(multOrder_), maxPts(maxPts_) {
 
-    comm = MPI_COMM_WORLD;
-    matrixPtr = new pvfmm::PtFMM<double>();
-    treeDataPtr = new pvfmm::PtFMM_Data<double>();
+    // a private communicator, so kernels can be initialized and evaluated concurrently
+    MPI_Comm_dup(MPI_COMM_WORLD, &comm);
 
     // choose a kernel
     kernelFunctionPtr = getKernelFunction(kernelChoice);
-    setKernel();
+    kdimSL = kernelFunctionPtr->k_s2t->ker_dim[0];
+    kdimTrg = kernelFunctionPtr->k_s2t->ker_dim[1];
+    kdimDL = kernelFunctionPtr->surf_dim;
 
-    // load periodicity M2L data
+    // a batched kernel stacks nBatch value sets of its unbatched kernel in each point
+    KERNEL unbatched = kernelChoice;
+    nBatch = 1;
+    for (const auto &it : batchKernelMap) {
+        if (it.second == kernelChoice) {
+            unbatched = it.first;
+            nBatch = nBatchRHS;
+        }
+    }
+    const auto &srcTable = srcScaleExponentTable.at(unbatched);
+    const auto &trgTable = trgScaleExponentTable.at(unbatched);
+    for (int b = 0; b < nBatch; b++) {
+        srcScaleExponent.insert(srcScaleExponent.end(), srcTable.begin(), srcTable.end());
+        trgScaleExponent.insert(trgScaleExponent.end(), trgTable.begin(), trgTable.end());
+    }
+    if (srcScaleExponent.size() != static_cast<size_t>(kdimSL) ||
+        trgScaleExponent.size() != static_cast<size_t>(kdimTrg)) {
+        std::cout << "scaling table error for kernel " << getKernelName(kernelChoice) << std::endl;
+        exit(1);
+    }
+
+    // periodicity L2T equivalent points
     if (periodicity != PAXIS::NONE) {
         // center at 0.5,0.5,0.5, periodic box 1,1,1, scale 1.05, depth = 0
         // RAD1 = 2.95 defined in pvfmm_common.h
@@ -79,59 +460,113 @@ FMMData::FMMData(KERNEL kernelChoice_, PAXIS periodicity_, int multOrder_, int m
         pCenterLEquiv[2] = -(scaleLEquiv - 1) / 2;
 
         equivCoord = surface(multOrder, (double *)&(pCenterLEquiv[0]), scaleLEquiv, 0);
+    }
+}
 
-        if (enableFF) {
-            setupPeriodicData();
-            matrixPtr->SetM2C(M2Cdata.data());
-        } else {
-            printf("PBC FF disabled\n");
-            matrixPtr->SetM2C(nullptr);
-        }
+void FMMData::prepare() {
+    if (periodicity != PAXIS::NONE && enableFF && !M2Cdata) {
+        setupPeriodicData();
+    }
+    if (precision == PRECISION::FLOAT)
+        kernelMapFloat.at(kernelChoice)->Initialize();
+    else
+        kernelFunctionPtr->Initialize();
+}
+
+void FMMData::initialize() {
+    if (initialized)
+        return;
+
+    // load periodicity M2C data, then translation operators in the working precision
+    prepare();
+    setKernel();
+    initialized = true;
+
+    if (maxPts <= 0) {
+        maxPts = MaxPtsTuner::tune(*this);
     }
 }
 
 FMMData::~FMMData() {
-    clear();
-    safeDeletePtr(treePtr);
-    safeDeletePtr(treeDataPtr);
-    safeDeletePtr(matrixPtr);
+    deleteTree();
+    safeDeletePtr(engineDouble);
+    safeDeletePtr(engineFloat);
+
+    int finalized;
+    MPI_Finalized(&finalized);
+    if (!finalized)
+        MPI_Comm_free(&comm);
+}
+
+bool FMMData::hasTree() const {
+    bool tree = false;
+    withEngine([&](auto &engine) { tree = (engine.tree != nullptr); });
+    return tree;
 }
 
 void FMMData::clear() {
-    //    treeDataPtr->Clear();
-    if (treePtr != nullptr)
-        treePtr->ClearFMMData();
+    withEngine([](auto &engine) {
+        if (engine.tree != nullptr)
+            engine.tree->ClearFMMData();
+    });
     return;
 }
 
 void FMMData::setupTree(const std::vector<double> &srcSLCoord, const std::vector<double> &srcDLCoord,
                         const std::vector<double> &trgCoord, const int ntreePts, const double *treePtsPtr) {
+    setupTree(srcSLCoord.size() / 3, srcSLCoord.data(), srcDLCoord.size() / 3, srcDLCoord.data(), trgCoord.size() / 3,
+              trgCoord.data(), ntreePts, treePtsPtr);
+}
+
+void FMMData::setupTree(const int nSL, const double *srcSLCoordPtr, const int nDL, const double *srcDLCoordPtr,
+                        const int nTrg, const double *trgCoordPtr, const int ntreePts, const double *treePtsPtr) {
+    initialize();
+    withEngine([&](auto &engine) {
+        this->setupTree(engine, nSL, srcSLCoordPtr, nDL, srcDLCoordPtr, nTrg, trgCoordPtr, ntreePts, treePtsPtr);
+    });
+    perf.setupCalls++;
+}
+
+template <class Real>
+void FMMData::setupTree(FMMEngine<Real> &engine, const int nSL, const double *srcSLCoordPtr, const int nDL,
+                        const double *srcDLCoordPtr, const int nTrg, const double *trgCoordPtr, const int ntreePts,
+                        const double *treePtsPtr) {
+    double time = MPI_Wtime();
+
     // trgCoord and srcCoord have been scaled to [0,1)^3
-    // setup treeData
-    treeDataPtr->dim = 3;
-    treeDataPtr->max_depth = PVFMM_MAX_DEPTH;
-    treeDataPtr->max_pts = maxPts;
-
-    treeDataPtr->src_coord = srcSLCoord;
-    treeDataPtr->surf_coord = srcDLCoord;
-    treeDataPtr->trg_coord = trgCoord;
-    const int nSL = srcSLCoord.size() / 3;
-    const int nDL = srcDLCoord.size() / 3;
-    const int nTrg = trgCoord.size() / 3;
+    // setup treeData, only needed during construction
+    // the tree keeps its own copy, so kernels do not hold duplicate point arrays
+    pvfmm::PtFMM_Data<Real> treeData;
+    treeData.dim = 3;
+    treeData.max_depth = PVFMM_MAX_DEPTH;
+    treeData.max_pts = maxPts;
+
+    // convert to the working precision
+    auto assign = [](pvfmm::Vector<Real> &v, const double *begin, const double *end) {
+        v.Resize(end - begin);
+        std::copy(begin, end, v.Begin());
+    };
+    assign(treeData.src_coord, srcSLCoordPtr, srcSLCoordPtr + 3 * nSL);
+    assign(treeData.surf_coord, srcDLCoordPtr, srcDLCoordPtr + 3 * nDL);
+    assign(treeData.trg_coord, trgCoordPtr, trgCoordPtr + 3 * nTrg);
+    nSLTree = nSL;
+    nDLTree = nDL;
+    nTrgTree = nTrg;
 
     // pt_coord is used to setup FMM octree
-    if (treePtsPtr == nullptr || ntreePts == 0) {
+    if ((treePtsPtr == nullptr || ntreePts == 0) && costWeighted) {
+        weightedTreePoints(treeData, nSL, srcSLCoordPtr, nDL, srcDLCoordPtr, nTrg, trgCoordPtr);
+    } else if (treePtsPtr == nullptr || ntreePts == 0) {
         // default case, use the largest set among SL/DL/Trg
         if (nSL > nDL && nSL > nTrg)
-            treeDataPtr->pt_coord = srcSLCoord;
+            treeData.pt_coord = treeData.src_coord;
         else if (nDL > nSL && nDL > nTrg)
-            treeDataPtr->pt_coord = srcDLCoord;
+            treeData.pt_coord = treeData.surf_coord;
         else
-            treeDataPtr->pt_coord = trgCoord;
+            treeData.pt_coord = treeData.trg_coord;
     } else {
         // custom case, use custom set of points
-        treeDataPtr->pt_coord.Resize(3 * ntreePts);
-        std::copy(treePtsPtr, treePtsPtr + 3 * ntreePts, treeDataPtr->pt_coord.Begin());
+        assign(treeData.pt_coord, treePtsPtr, treePtsPtr + 3 * ntreePts);
     }
 
     int rank;
@@ -141,14 +576,16 @@ void FMMData::setupTree(const std::vector<double> &srcSLCoord, const std::vector
         std::cout << "Rank " << rank << ", nSL " << nSL << ", nDL " << nDL << ", nTrg " << nTrg << std::endl;
 
     // space allocate
-    treeDataPtr->src_value.Resize(nSL * kdimSL);
-    treeDataPtr->surf_value.Resize(nDL * kdimDL);
-    treeDataPtr->trg_value.Resize(nTrg * kdimTrg);
+    treeData.src_value.Resize(nSL * kdimSL);
+    treeData.surf_value.Resize(nDL * kdimDL);
+    treeData.trg_value.Resize(nTrg * kdimTrg);
+    tick(PHASE::INGEST, time);
 
     // construct tree
-    treePtr = new pvfmm::PtFMM_Tree<double>(comm);
+    safeDeletePtr(engine.tree);
+    engine.tree = new pvfmm::PtFMM_Tree<Real>(comm);
     // printf("tree alloc\n");
-    treePtr->Initialize(treeDataPtr);
+    engine.tree->Initialize(&treeData);
     // printf("tree init\n");
 
     pvfmm::BoundaryType bc = pvfmm::BoundaryType::FreeSpace;
@@ -159,24 +596,246 @@ void FMMData::setupTree(const std::vector<double> &srcSLCoord, const std::vector
     else if (periodicity == stkfmm::PAXIS::PXYZ)
         bc = pvfmm::BoundaryType::PXYZ;
 
-    treePtr->InitFMM_Tree(true, bc);
+    engine.tree->InitFMM_Tree(true, bc);
     // printf("tree build\n");
-    treePtr->SetupFMM(matrixPtr);
+    tick(PHASE::TREEBUILD, time);
+    engine.tree->SetupFMM(&engine.matrix);
     // printf("tree fmm matrix setup\n");
+    tick(PHASE::SETUPFMM, time);
     return;
 }
 
+bool FMMData::updateTree(const int nSL, const double *srcSLCoordPtr, const int nDL, const double *srcDLCoordPtr,
+                         const int nTrg, const double *trgCoordPtr, const double imbalanceThreshold) {
+    bool kept = false;
+    withEngine([&](auto &engine) {
+        kept = this->updateTree(engine, nSL, srcSLCoordPtr, nDL, srcDLCoordPtr, nTrg, trgCoordPtr, imbalanceThreshold);
+    });
+    return kept;
+}
+
+template <class Real>
+bool FMMData::updateTree(FMMEngine<Real> &engine, const int nSL, const double *srcSLCoordPtr, const int nDL,
+                         const double *srcDLCoordPtr, const int nTrg, const double *trgCoordPtr,
+                         const double imbalanceThreshold) {
+    // the scatter indices in the leaves are only valid for the points the tree was built from
+    int samePoints = (engine.tree != nullptr && nSL == nSLTree && nDL == nDLTree && nTrg == nTrgTree);
+    MPI_Allreduce(MPI_IN_PLACE, &samePoints, 1, MPI_INT, MPI_LAND, comm);
+    if (!samePoints)
+        return false;
+
+    double time = MPI_Wtime();
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    std::vector<decltype(engine.tree->RootNode())> leaves;
+    for (auto node : engine.tree->GetNodeList()) {
+        if (node->IsLeaf() && !node->IsGhost())
+            leaves.push_back(node);
+    }
+
+    // new coordinates in tree order, scattered the same way as the values in evaluateFMM()
+    const double *coordPtrs[3] = {srcSLCoordPtr, srcDLCoordPtr, trgCoordPtr};
+    const int nPts[3] = {nSL, nDL, nTrg};
+    pvfmm::Vector<Real> coords[3];
+    for (int k = 0; k < 3; k++) {
+        std::vector<size_t> index;
+        for (auto leaf : leaves) {
+            const pvfmm::Vector<size_t> *scatters[3] = {&leaf->src_scatter, &leaf->surf_scatter, &leaf->trg_scatter};
+            index.insert(index.end(), scatters[k]->Begin(), scatters[k]->Begin() + scatters[k]->Dim());
+        }
+        pvfmm::Vector<size_t> scatter;
+        scatter.Resize(index.size());
+        std::copy(index.begin(), index.end(), scatter.Begin());
+
+        coords[k].Resize(3 * nPts[k]);
+        std::copy(coordPtrs[k], coordPtrs[k] + 3 * nPts[k], coords[k].Begin());
+        pvfmm::par::ScatterForward(coords[k], scatter, comm);
+    }
+
+    // pvfmm cannot move a point to another leaf of an existing tree
+    int nLeft = 0;
+    size_t offset[3] = {0, 0, 0};
+    for (auto leaf : leaves) {
+        const Real *origin = leaf->Coord();
+        const Real side = std::pow(0.5, leaf->Depth());
+        const pvfmm::Vector<Real> *leafCoords[3] = {&leaf->src_coord, &leaf->surf_coord, &leaf->trg_coord};
+        for (int k = 0; k < 3; k++) {
+            const size_t n = leafCoords[k]->Dim();
+            for (size_t i = 0; i < n; i++) {
+                const Real x = coords[k][offset[k] + i];
+                nLeft += (x < origin[i % 3] || x >= origin[i % 3] + side);
+            }
+            offset[k] += n;
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &nLeft, 1, MPI_INT, MPI_SUM, comm);
+    if (nLeft > 0) {
+        if (stkfmm::verbose && rank == 0)
+            std::cout << nLeft << " coordinates left their leaves, tree must be rebuilt\n";
+        return false;
+    }
+
+    std::fill(offset, offset + 3, 0);
+    for (auto leaf : leaves) {
+        pvfmm::Vector<Real> *leafCoords[3] = {&leaf->src_coord, &leaf->surf_coord, &leaf->trg_coord};
+        for (int k = 0; k < 3; k++) {
+            const size_t n = leafCoords[k]->Dim();
+            std::copy(coords[k].Begin() + offset[k], coords[k].Begin() + offset[k] + n, leafCoords[k]->Begin());
+            offset[k] += n;
+        }
+    }
+    tick(PHASE::INGEST, time);
+
+    // the partition was made for the old points, repartition by rebuilding once it is too far off
+    const double treeImbalance = imbalance(engine);
+    if (treeImbalance > imbalanceThreshold) {
+        if (stkfmm::verbose && rank == 0)
+            std::cout << "imbalance " << treeImbalance << " above " << imbalanceThreshold << ", tree must be rebuilt\n";
+        return false;
+    }
+    tick(PHASE::TREEBUILD, time);
+
+    // ghost copies and interaction data of the moved points
+    engine.tree->SetupFMM(&engine.matrix);
+    tick(PHASE::SETUPFMM, time);
+    return true;
+}
+
+CostModel FMMData::makeCostModel() const {
+    return CostModel(kdimSL, kdimDL, kdimTrg, kernelFunctionPtr->k_m2l->ker_dim[0], multOrder, maxPts);
+}
+
+template <class Real>
+void FMMData::weightedTreePoints(pvfmm::PtFMM_Data<Real> &treeData, const int nSL, const double *srcSLCoordPtr,
+                                 const int nDL, const double *srcDLCoordPtr, const int nTrg,
+                                 const double *trgCoordPtr) {
+    const double *coords[3] = {srcSLCoordPtr, srcDLCoordPtr, trgCoordPtr};
+    const int nPts[3] = {nSL, nDL, nTrg};
+    const CostModel::PointType types[3] = {CostModel::SL, CostModel::DL, CostModel::TRG};
+
+    CostModel cost = makeCostModel();
+    for (int k = 0; k < 3; k++) {
+        cost.count(nPts[k], coords[k], types[k]);
+    }
+    cost.reduce(comm);
+
+    // total weight, SL, DL, Trg number of points
+    double sum[4] = {0, 0, 0, 0};
+    std::vector<double> weights[3];
+    for (int k = 0; k < 3; k++) {
+        weights[k].resize(nPts[k]);
+        for (int i = 0; i < nPts[k]; i++) {
+            weights[k][i] = cost.weight(coords[k] + 3 * i, types[k]);
+            sum[0] += weights[k][i];
+        }
+        sum[k + 1] = nPts[k];
+    }
+    MPI_Allreduce(MPI_IN_PLACE, sum, 4, MPI_DOUBLE, MPI_SUM, comm);
+    const double meanWeight = sum[0] / std::max(sum[1] + sum[2] + sum[3], 1.0);
+
+    // every point at least once, at most 8 times, far below maxPts
+    std::vector<Real> ptCoord;
+    for (int k = 0; k < 3; k++) {
+        const double *coord = coords[k];
+        for (size_t i = 0; i < weights[k].size(); i++) {
+            const int repeat = std::min(std::max(static_cast<int>(std::lround(weights[k][i] / meanWeight)), 1), 8);
+            for (int r = 0; r < repeat; r++)
+                ptCoord.insert(ptCoord.end(), coord + 3 * i, coord + 3 * i + 3);
+        }
+    }
+    treeData.pt_coord.Resize(ptCoord.size());
+    std::copy(ptCoord.begin(), ptCoord.end(), treeData.pt_coord.Begin());
+
+    double nTreePts = ptCoord.size() / 3;
+    MPI_Allreduce(MPI_IN_PLACE, &nTreePts, 1, MPI_DOUBLE, MPI_SUM, comm);
+    const double nLargest = std::max(std::max(sum[1], sum[2]), std::max(sum[3], 1.0));
+    treeData.max_pts = std::max(static_cast<int>(std::lround(maxPts * nTreePts / nLargest)), 1);
+}
+
+MemoryUsage FMMData::getMemoryUsage() const {
+    MemoryUsage usage;
+    withEngine([&](auto &engine) {
+        const std::size_t realBytes = sizeof(typename decltype(engine.trgValue)::value_type);
+        usage.periodic = engine.M2C.capacity() * realBytes;
+        usage.tree = this->treeBytes(engine);
+        usage.work =
+            (engine.srcSLValue.capacity() + engine.srcDLValue.capacity() + engine.trgValue.capacity()) * realBytes;
+    });
+    return usage;
+}
+
+template <class Real>
+std::size_t FMMData::treeBytes(const FMMEngine<Real> &engine) const {
+    if (engine.tree == nullptr)
+        return 0;
+    std::size_t n = 0;
+    for (auto node : engine.tree->GetNodeList()) {
+        n += node->src_coord.Dim() + node->src_value.Dim() + node->surf_coord.Dim() + node->surf_value.Dim() +
+             node->trg_coord.Dim() + node->trg_value.Dim();
+        auto data = node->FMMData();
+        if (data != nullptr)
+            n += data->upward_equiv.Dim() + data->dnward_equiv.Dim();
+    }
+    return n * sizeof(Real);
+}
+
+double FMMData::getImbalance() {
+    double result = 1;
+    withEngine([&](auto &engine) { result = this->imbalance(engine); });
+    return result;
+}
+
+template <class Real>
+double FMMData::imbalance(const FMMEngine<Real> &engine) {
+    if (engine.tree == nullptr)
+        return 1;
+
+    std::vector<decltype(engine.tree->RootNode())> leaves;
+    for (auto node : engine.tree->GetNodeList()) {
+        if (node->IsLeaf() && !node->IsGhost())
+            leaves.push_back(node);
+    }
+
+    CostModel cost = makeCostModel();
+    for (auto leaf : leaves) {
+        cost.count(leaf->src_coord.Dim() / 3, leaf->src_coord.Begin(), CostModel::SL);
+        cost.count(leaf->surf_coord.Dim() / 3, leaf->surf_coord.Begin(), CostModel::DL);
+        cost.count(leaf->trg_coord.Dim() / 3, leaf->trg_coord.Begin(), CostModel::TRG);
+    }
+    cost.reduce(comm);
+
+    double work = 0;
+    for (auto leaf : leaves) {
+        const pvfmm::Vector<Real> *coords[3] = {&leaf->src_coord, &leaf->surf_coord, &leaf->trg_coord};
+        const CostModel::PointType types[3] = {CostModel::SL, CostModel::DL, CostModel::TRG};
+        for (int k = 0; k < 3; k++) {
+            const int npts = coords[k]->Dim() / 3;
+            for (int i = 0; i < npts; i++)
+                work += cost.weight(coords[k]->Begin() + 3 * i, types[k]);
+        }
+    }
+
+    int nProcs;
+    MPI_Comm_size(comm, &nProcs);
+    double maxWork = 0, sumWork = 0;
+    MPI_Allreduce(&work, &maxWork, 1, MPI_DOUBLE, MPI_MAX, comm);
+    MPI_Allreduce(&work, &sumWork, 1, MPI_DOUBLE, MPI_SUM, comm);
+    return sumWork > 0 ? maxWork * nProcs / sumWork : 1;
+}
+
 void FMMData::deleteTree() {
     clear();
-    safeDeletePtr(treePtr);
+    withEngine([](auto &engine) { safeDeletePtr(engine.tree); });
+    nSLTree = nDLTree = nTrgTree = 0;
     return;
 }
 
 void FMMData::evaluateFMM(std::vector<double> &srcSLValue, std::vector<double> &srcDLValue,
                           std::vector<double> &trgValue, const double scale) {
-    const int nSrc = treeDataPtr->src_coord.Dim() / 3;
-    const int nSurf = treeDataPtr->surf_coord.Dim() / 3;
-    const int nTrg = treeDataPtr->trg_coord.Dim() / 3;
+    const int nSrc = nSLTree;
+    const int nSurf = nDLTree;
+    const int nTrg = nTrgTree;
 
     int rank;
     MPI_Comm_rank(comm, &rank);
@@ -193,27 +852,55 @@ void FMMData::evaluateFMM(std::vector<double> &srcSLValue, std::vector<double> &
         std::cout << "src DL value size error from rank " << rank << std::endl;
         exit(1);
     }
-    scaleSrc(srcSLValue, srcDLValue, scale);
-    std::fill(trgValue.begin(), trgValue.end(), 0.0);
-    PtFMM_Evaluate(treePtr, trgValue, nTrg, &srcSLValue, &srcDLValue);
-    periodizeFMM(trgValue);
-    scaleTrg(trgValue, scale);
+    evaluateFMM(nSrc, srcSLValue.data(), nSurf, srcDLValue.data(), nTrg, trgValue.data(), scale, EVALMODE::OVERWRITE);
 }
 
-void FMMData::periodizeFMM(std::vector<double> &trgValue) {
+void FMMData::evaluateFMM(const int nSL, const double *srcSLValuePtr, const int nDL, const double *srcDLValuePtr,
+                          const int nTrg, double *trgValuePtr, const double scale, const EVALMODE mode,
+                          const int nRHS) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    if (nTrg != nTrgTree) {
+        std::cout << "trg number error from rank " << rank << std::endl;
+        exit(1);
+    }
+    if (nSL != nSLTree) {
+        std::cout << "src SL number error from rank " << rank << std::endl;
+        exit(1);
+    }
+    if (hasDL() && nDL != nDLTree) {
+        std::cout << "src DL number error from rank " << rank << std::endl;
+        exit(1);
+    }
+
+    // pvfmm takes std::vector, the buffers keep their capacity between calls
+    withEngine([&](auto &engine) {
+        double time = MPI_Wtime();
+        this->copyScaledSrc(engine, nSL, srcSLValuePtr, this->hasDL() ? nDL : 0, srcDLValuePtr, scale, nRHS);
+        this->tick(PHASE::SCALING, time);
+        PtFMM_Evaluate(engine.tree, engine.trgValue, nTrg, &engine.srcSLValue, &engine.srcDLValue);
+        this->tick(PHASE::FMM, time);
+        this->postProcess(engine, nTrg, engine.trgValue.data(), trgValuePtr, scale, mode, nRHS);
+    });
+    perf.evaluateCalls++;
+}
+
+template <class Real>
+void FMMData::periodicShift(const FMMEngine<Real> &engine, std::vector<double> &trgShift) {
+    trgShift.assign(kdimTrg, 0.0);
     if (periodicity == PAXIS::NONE || enableFF == false) {
         return;
     }
 
     // the value calculated by pvfmm
-    const pvfmm::Vector<double> v = treePtr->RootNode()->FMMData()->upward_equiv;
-    const auto &trgCoord = treeDataPtr->trg_coord;
-    const int nTrg = trgCoord.Dim() / 3;
+    const pvfmm::Vector<Real> v = engine.tree->RootNode()->FMMData()->upward_equiv;
     const int equivN = equivCoord.size() / 3;
 
     // post correction of net flux for stokes_PVel kernels
     if (periodicity == PAXIS::PXYZ &&
-        (kernelChoice == KERNEL::PVel || kernelChoice == KERNEL::PVelGrad || kernelChoice == KERNEL::PVelLaplacian)) {
+        (kernelChoice == KERNEL::PVel || kernelChoice == KERNEL::PVelGrad || kernelChoice == KERNEL::PVelLaplacian ||
+         kernelChoice == KERNEL::PVelTraction)) {
 
         double scaleMEquiv = PVFMM_RAD0;
         double pCenterMEquiv[3];
@@ -239,18 +926,58 @@ void FMMData::periodizeFMM(std::vector<double> &trgValue) {
         for (int j = 0; j < 3; j++) {
             vel[j] = (dipoleM[j] - dipoleMP[j]) * 0.5;
         }
-        const int kdimTrg = this->kdimTrg;
-#pragma omp parallel for
-        for (int t = 0; t < nTrg; t++) {
-            trgValue[t * kdimTrg + 1] += vel[0];
-            trgValue[t * kdimTrg + 2] += vel[1];
-            trgValue[t * kdimTrg + 3] += vel[2];
+        trgShift[1] = vel[0];
+        trgShift[2] = vel[1];
+        trgShift[3] = vel[2];
+    }
+}
+
+template <class Real>
+void FMMData::postProcess(const FMMEngine<Real> &engine, const int nTrg, const Real *trgValue, double *trgValuePtr,
+                          const double scale, const EVALMODE mode, const int nRHS) {
+    // per component: value = (pvfmm value + periodic shift) * scale^exponent
+    double time = MPI_Wtime();
+    const int kdimTrg = this->kdimTrg;
+    const int stride = nRHS * kdimTrg / nBatch; // between points in trgValuePtr
+    std::vector<double> shift;
+    periodicShift(engine, shift);
+    tick(PHASE::PERIODIZE, time);
+    std::vector<double> factor(kdimTrg);
+    for (int j = 0; j < kdimTrg; j++) {
+        factor[j] = std::pow(scale, trgScaleExponent[j]);
+    }
+    const double *shiftPtr = shift.data();
+    const double *factorPtr = factor.data();
+
+    // one sweep, static schedule so each thread streams one contiguous block
+    if (mode == EVALMODE::OVERWRITE) {
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < nTrg; i++) {
+#pragma omp simd
+            for (int j = 0; j < kdimTrg; j++) {
+                trgValuePtr[i * stride + j] = (trgValue[i * kdimTrg + j] + shiftPtr[j]) * factorPtr[j];
+            }
+        }
+    } else {
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < nTrg; i++) {
+#pragma omp simd
+            for (int j = 0; j < kdimTrg; j++) {
+                trgValuePtr[i * stride + j] += (trgValue[i * kdimTrg + j] + shiftPtr[j]) * factorPtr[j];
+            }
         }
     }
+    tick(PHASE::COPYOUT, time);
 }
 
 void FMMData::evaluateKernel(int nThreads, PPKERNEL p2p, const int nSrc, double *srcCoordPtr, double *srcValuePtr,
                              const int nTrg, double *trgCoordPtr, double *trgValuePtr) {
+    evaluateKernel(kernelFunctionPtr, nThreads, p2p, nSrc, srcCoordPtr, srcValuePtr, nTrg, trgCoordPtr, trgValuePtr);
+}
+
+void FMMData::evaluateKernel(const pvfmm::Kernel<double> *kernelFunctionPtr, int nThreads, PPKERNEL p2p,
+                             const int nSrc, double *srcCoordPtr, double *srcValuePtr, const int nTrg,
+                             double *trgCoordPtr, double *trgValuePtr) {
     if (nThreads < 1 || nThreads > omp_get_max_threads()) {
         nThreads = omp_get_max_threads();
     }
@@ -259,12 +986,14 @@ void FMMData::evaluateKernel(int nThreads, PPKERNEL p2p, const int nSrc, double
     const int chunkNumber = floor(1.0 * (nTrg) / chunkSize) + 1;
 
     pvfmm::Kernel<double>::Ker_t kerPtr = nullptr; // a function pointer
+    int kdimTrg = kernelFunctionPtr->k_s2t->ker_dim[1];
     if (p2p == PPKERNEL::SLS2T) {
         kerPtr = kernelFunctionPtr->k_s2t->ker_poten;
     } else if (p2p == PPKERNEL::DLS2T) {
         kerPtr = kernelFunctionPtr->k_s2t->dbl_layer_poten;
     } else if (p2p == PPKERNEL::L2T) {
         kerPtr = kernelFunctionPtr->k_l2t->ker_poten;
+        kdimTrg = kernelFunctionPtr->k_l2t->ker_dim[1];
     }
 
     if (kerPtr == nullptr) {
@@ -282,190 +1011,44 @@ void FMMData::evaluateKernel(int nThreads, PPKERNEL p2p, const int nSrc, double
     }
 }
 
-void FMMData::scaleSrc(std::vector<double> &srcSLValue, std::vector<double> &srcDLValue, const double scaleFactor) {
+template <class Real>
+void FMMData::copyScaledSrc(FMMEngine<Real> &engine, const int nSL, const double *srcSLValuePtr, const int nDL,
+                            const double *srcDLValuePtr, const double scaleFactor, const int nRHS) {
     // scale the source strength, SL as 1/r, DL as 1/r^2
-    // SL no extra scaling
-    // DL scale as scaleFactor
-
-    const int nloop = srcDLValue.size();
-#pragma omp parallel for
-    for (int i = 0; i < nloop; i++) {
-        srcDLValue[i] *= scaleFactor;
+    // DL and some SL components scale as scaleFactor
+    const int kdimSL = this->kdimSL;
+    const int kdimDL = this->kdimDL;
+    // between points in the value arrays
+    const int strideSL = nRHS * kdimSL / nBatch;
+    const int strideDL = nRHS * kdimDL / nBatch;
+    std::vector<double> factor(kdimSL);
+    for (int j = 0; j < kdimSL; j++) {
+        factor[j] = std::pow(scaleFactor, srcScaleExponent[j]);
     }
+    const double *factorPtr = factor.data();
+    engine.srcSLValue.resize(nSL * kdimSL);
+    engine.srcDLValue.resize(nDL * kdimDL);
 
-    const int nSL = srcSLValue.size() / kdimSL;
-    if (kernelChoice == KERNEL::PVel || kernelChoice == KERNEL::PVelGrad || kernelChoice == KERNEL::PVelLaplacian ||
-        kernelChoice == KERNEL::Traction || kernelChoice == KERNEL::RPY || kernelChoice == KERNEL::StokesRegVel) {
-        // Stokes, RPY, StokesRegVel
+    Real *srcSL = engine.srcSLValue.data();
 #pragma omp parallel for
-        for (int i = 0; i < nSL; i++) {
-            // the Trace term of PVel
-            // the epsilon terms of RPY/StokesRegVel
-            // scale as double layer
-            srcSLValue[4 * i + 3] *= scaleFactor;
+    for (int i = 0; i < nSL; i++) {
+        for (int j = 0; j < kdimSL; j++) {
+            srcSL[kdimSL * i + j] = factorPtr[j] * srcSLValuePtr[strideSL * i + j];
         }
     }
 
-    if (kernelChoice == KERNEL::StokesRegVelOmega) {
-#pragma omp parallel for
-        for (int i = 0; i < nSL; i++) {
-            // Scale torque / epsilon
-            for (int j = 3; j < 7; ++j)
-                srcSLValue[7 * i + j] *= scaleFactor;
-        }
+    if (nDL == 0)
+        return;
+    Real *srcDL = engine.srcDLValue.data();
+    if (srcDLValuePtr == nullptr) {
+        std::fill(srcDL, srcDL + nDL * kdimDL, Real(0));
+        return;
     }
-}
-
-void FMMData::scaleTrg(std::vector<double> &trgValue, const double scaleFactor) {
-
-    const int nTrg = trgValue.size() / kdimTrg;
-    // scale back according to kernel
-    switch (kernelChoice) {
-    case KERNEL::PVel: {
-        // 1+3
 #pragma omp parallel for
-        for (int i = 0; i < nTrg; i++) {
-            // pressure 1/r^2
-            trgValue[4 * i] *= scaleFactor * scaleFactor;
-            // vel 1/r
-            trgValue[4 * i + 1] *= scaleFactor;
-            trgValue[4 * i + 2] *= scaleFactor;
-            trgValue[4 * i + 3] *= scaleFactor;
-        }
-    } break;
-    case KERNEL::PVelGrad: {
-        // 1+3+3+9
-#pragma omp parallel for
-        for (int i = 0; i < nTrg; i++) {
-            // p
-
-            trgValue[16 * i] *= scaleFactor * scaleFactor;
-            // vel
-            for (int j = 1; j < 4; j++) {
-                trgValue[16 * i + j] *= scaleFactor;
-            }
-            // grad p
-            for (int j = 4; j < 7; j++) {
-                trgValue[16 * i + j] *= scaleFactor * scaleFactor * scaleFactor;
-            }
-            // grad vel
-            for (int j = 7; j < 16; j++) {
-                trgValue[16 * i + j] *= scaleFactor * scaleFactor;
-            }
-        }
-    } break;
-    case KERNEL::Traction: {
-        // 9
-        int nloop = 9 * nTrg;
-#pragma omp parallel for
-        for (int i = 0; i < nloop; i++) {
-            // traction 1/r^2
-            trgValue[i] *= scaleFactor * scaleFactor;
-        }
-    } break;
-    case KERNEL::PVelLaplacian: {
-        // 1+3+3
-#pragma omp parallel for
-        for (int i = 0; i < nTrg; i++) {
-            // p
-            trgValue[7 * i] *= scaleFactor * scaleFactor;
-            // vel
-            for (int j = 1; j < 4; j++) {
-                trgValue[7 * i + j] *= scaleFactor;
-            }
-            // laplacian vel
-            for (int j = 4; j < 7; j++) {
-                trgValue[7 * i + j] *= scaleFactor * scaleFactor * scaleFactor;
-            }
-        }
-    } break;
-    case KERNEL::LapPGrad: {
-        // 1+3
-#pragma omp parallel for
-        for (int i = 0; i < nTrg; i++) {
-            // p, 1/r
-            trgValue[4 * i] *= scaleFactor;
-            // grad p, 1/r^2
-            for (int j = 1; j < 4; j++) {
-                trgValue[4 * i + j] *= scaleFactor * scaleFactor;
-            }
-        }
-    } break;
-    case KERNEL::LapPGradGrad: {
-        // 1+3+6
-#pragma omp parallel for
-        for (int i = 0; i < nTrg; i++) {
-            // p, 1/r
-            trgValue[10 * i] *= scaleFactor;
-            // grad p, 1/r^2
-            for (int j = 1; j < 4; j++) {
-                trgValue[10 * i + j] *= scaleFactor * scaleFactor;
-            }
-            // grad grad p, 1/r^3
-            for (int j = 4; j < 10; j++) {
-                trgValue[10 * i + j] *= scaleFactor * scaleFactor * scaleFactor;
-            }
-        }
-    } break;
-    case KERNEL::LapQPGradGrad: {
-        // 1+3+6
-        const double sf3 = scaleFactor * scaleFactor * scaleFactor;
-        const double sf4 = scaleFactor * sf3;
-        const double sf5 = scaleFactor * sf4;
-#pragma omp parallel for
-        for (int i = 0; i < nTrg; i++) {
-            // p, 1/r^3
-            trgValue[10 * i] *= sf3;
-            // grad p, 1/r^4
-            for (int j = 1; j < 4; j++) {
-                trgValue[10 * i + j] *= sf4;
-            }
-            // grad grad p, 1/r^5
-            for (int j = 4; j < 10; j++) {
-                trgValue[10 * i + j] *= sf5;
-            }
-        }
-    } break;
-    case KERNEL::Stokes: {
-        // 3
-        const int nloop = nTrg * 3;
-#pragma omp parallel for
-        for (int i = 0; i < nloop; i++) {
-            trgValue[i] *= scaleFactor; // vel 1/r
-        }
-    } break;
-    case KERNEL::StokesRegVel: {
-        // 3
-        const int nloop = nTrg * 3;
-#pragma omp parallel for
-        for (int i = 0; i < nloop; i++) {
-            trgValue[i] *= scaleFactor; // vel 1/r
-        }
-    } break;
-    case KERNEL::StokesRegVelOmega: {
-        // 3 + 3
-#pragma omp parallel for
-        for (int i = 0; i < nTrg; i++) {
-            // vel 1/r
-            for (int j = 0; j < 3; ++j)
-                trgValue[i * 6 + j] *= scaleFactor;
-            // omega 1/r^2
-            for (int j = 3; j < 6; ++j)
-                trgValue[i * 6 + j] *= scaleFactor * scaleFactor;
-        }
-    } break;
-    case KERNEL::RPY: {
-        // 3 + 3
-#pragma omp parallel for
-        for (int i = 0; i < nTrg; i++) {
-            // vel 1/r
-            for (int j = 0; j < 3; ++j)
-                trgValue[i * 6 + j] *= scaleFactor;
-            // laplacian vel
-            for (int j = 3; j < 6; ++j)
-                trgValue[i * 6 + j] *= scaleFactor * scaleFactor * scaleFactor;
+    for (int i = 0; i < nDL; i++) {
+        for (int j = 0; j < kdimDL; j++) {
+            srcDL[kdimDL * i + j] = scaleFactor * srcDLValuePtr[strideDL * i + j];
         }
-    } break;
     }
 }
 
@@ -0,0 +1,120 @@
+#include "STKFMM/MaxPtsTuner.hpp"
+#include "STKFMM/STKFMM_impl.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+namespace stkfmm {
+namespace impl {
+
+std::string MaxPtsTuner::profileFile(const FMMData &fmm) {
+    char *env = getenv("STKFMM_PROFILE");
+    if (env != nullptr && env[0] != '\0')
+        return std::string(env);
+    const std::string cacheDir = OperatorCache::translationCacheDir(fmm.getComm());
+    return cacheDir.empty() ? std::string() : cacheDir + "/maxPts.txt";
+}
+
+int MaxPtsTuner::tune(FMMData &fmm) {
+    MPI_Comm comm = fmm.getComm();
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // one line per entry: kernel order precision pbc threads maxPts
+    const std::string file = profileFile(fmm);
+    std::ostringstream key;
+    key << getKernelName(fmm.kernelChoice) << " " << fmm.multOrder << " "
+        << (fmm.precision == PRECISION::FLOAT ? "float" : "double") << " pbc" << asInteger(fmm.periodicity) << " "
+        << omp_get_max_threads();
+
+    // rank 0 reads, the last matching entry wins
+    int maxPts = 0;
+    if (rank == 0 && !file.empty()) {
+        std::ifstream fin(file);
+        std::string line;
+        while (std::getline(fin, line)) {
+            const auto pos = line.rfind(' ');
+            if (pos != std::string::npos && line.substr(0, pos) == key.str())
+                maxPts = atoi(line.substr(pos + 1).c_str());
+        }
+    }
+    MPI_Bcast(&maxPts, 1, MPI_INT, 0, comm);
+    if (maxPts > 0) {
+        if (stkfmm::verbose && rank == 0)
+            std::cout << "maxPts " << maxPts << " for " << key.str() << " from " << file << std::endl;
+        return maxPts;
+    }
+
+    maxPts = measure(fmm);
+    if (rank == 0) {
+        if (stkfmm::verbose)
+            std::cout << "maxPts " << maxPts << " tuned for " << key.str() << std::endl;
+        if (file.empty()) {
+            if (stkfmm::verbose)
+                std::cout << "set STKFMM_PROFILE or STKFMM_CACHE_DIR to keep tuned maxPts" << std::endl;
+        } else {
+            std::ofstream fout(file, std::ios::app);
+            fout << key.str() << " " << maxPts << std::endl;
+            if (!fout)
+                std::cout << "cannot write " << file << std::endl;
+        }
+    }
+    return maxPts;
+}
+
+int MaxPtsTuner::measure(FMMData &fmm) {
+    MPI_Comm comm = fmm.getComm();
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // random sources and targets in [0,1)^3
+    const int nPts = 32768;
+    std::mt19937 gen(rank);
+    std::uniform_real_distribution<double> dist(0, 1);
+    std::vector<double> coord(3 * nPts);
+    for (auto &x : coord)
+        x = dist(gen);
+    std::vector<double> srcValue(nPts * fmm.kdimSL);
+    for (auto &v : srcValue)
+        v = dist(gen) - 0.5;
+    std::vector<double> trgValue(nPts * fmm.kdimTrg);
+    const std::vector<double> empty;
+
+    // tuning runs are not user work, keep them out of the counters
+    const PerfCounters perf = fmm.perf;
+
+    const int candidates[] = {250, 500, 1000, 2000, 4000};
+    int best = 0;
+    double bestTime = 0;
+    for (const int maxPts : candidates) {
+        fmm.maxPts = maxPts;
+        // the first evaluation after setupTree allocates, time the second one
+        MPI_Barrier(comm);
+        double time = MPI_Wtime();
+        fmm.setupTree(coord, empty, coord);
+        const double setupTime = MPI_Wtime() - time;
+        fmm.evaluateFMM(nPts, srcValue.data(), 0, nullptr, nPts, trgValue.data(), 1.0, EVALMODE::OVERWRITE);
+        fmm.clear();
+        time = MPI_Wtime();
+        fmm.evaluateFMM(nPts, srcValue.data(), 0, nullptr, nPts, trgValue.data(), 1.0, EVALMODE::OVERWRITE);
+        fmm.clear();
+        time = setupTime + MPI_Wtime() - time;
+        MPI_Allreduce(MPI_IN_PLACE, &time, 1, MPI_DOUBLE, MPI_MAX, comm);
+
+        if (stkfmm::verbose && rank == 0)
+            std::cout << "maxPts " << maxPts << " time " << time << std::endl;
+        if (best == 0 || time < bestTime) {
+            best = maxPts;
+            bestTime = time;
+        }
+    }
+    fmm.deleteTree();
+    fmm.perf = perf;
+    return best;
+}
+
+} // namespace impl
+} // namespace stkfmm
@@ -0,0 +1,270 @@
+#include "STKFMM/OperatorCache.hpp"
+#include "STKFMM/STKFMM_common.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace stkfmm {
+namespace impl {
+
+namespace {
+struct Entry {
+    std::string name;
+    std::shared_ptr<const OperatorMatrix> mat;
+};
+// guards the maps only, never held across a collective call
+std::mutex cacheMutex;
+// by id, the same on every rank, so release() visits the entries in the same order on every rank
+std::map<long long, Entry> cache;
+// name -> id of the entry returned on a hit
+std::map<std::string, long long> latest;
+// ids handed out by this process
+long long serial = 0;
+} // namespace
+
+bool OperatorCache::readOnEveryNode() {
+    char *env = getenv("STKFMM_OPERATOR_READER");
+    return env != nullptr && std::string(env) == "node";
+}
+
+MPI_Comm OperatorCache::splitNode(MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm nodeComm;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nodeComm);
+
+    char *env = getenv("STKFMM_RANKS_PER_NODE");
+    const int ranksPerNode = env == nullptr ? 0 : atoi(env);
+    if (ranksPerNode > 0) {
+        int nodeRank;
+        MPI_Comm_rank(nodeComm, &nodeRank);
+        MPI_Comm group;
+        MPI_Comm_split(nodeComm, nodeRank / ranksPerNode, nodeRank, &group);
+        MPI_Comm_free(&nodeComm);
+        nodeComm = group;
+    }
+    return nodeComm;
+}
+
+std::string OperatorCache::translationCacheDir(MPI_Comm comm) {
+    char *env = getenv("STKFMM_CACHE_DIR");
+    if (env == nullptr || env[0] == '\0')
+        return std::string();
+
+#ifdef STKFMM_ABI_HASH
+    const std::string dir = std::string(env) + "/" + STKFMM_ABI_HASH;
+#else
+    const std::string dir = std::string(env) + "/dev";
+#endif
+
+    // mkdir -p on rank 0, everyone waits for it
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    int ok = 1;
+    if (rank == 0) {
+        for (std::size_t pos = dir.find('/', 1); ok; pos = dir.find('/', pos + 1)) {
+            const std::string sub = dir.substr(0, pos);
+            struct stat st;
+            if (stat(sub.c_str(), &st) != 0 && mkdir(sub.c_str(), 0755) != 0 && errno != EEXIST)
+                ok = 0;
+            if (pos == std::string::npos)
+                break;
+        }
+        if (!ok)
+            std::cout << "cannot create cache directory " << dir << ", translation operators not cached" << std::endl;
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+    return ok ? dir : std::string();
+}
+
+std::shared_ptr<const OperatorMatrix> OperatorCache::get(const std::string &name, MPI_Comm comm,
+                                                         const Loader &loader, const Prepare &prepare) {
+    // a hit only if every rank holds the same entry. Concurrent misses on other communicators may have
+    // stored different entries for this name on different ranks
+    std::shared_ptr<const OperatorMatrix> found;
+    long long id[2] = {0, 0}; // min of id and -id
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        auto it = latest.find(name);
+        if (it != latest.end()) {
+            found = cache.at(it->second).mat;
+            id[0] = it->second;
+            id[1] = -it->second;
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, id, 2, MPI_LONG_LONG, MPI_MIN, comm);
+    if (id[0] != 0 && id[0] == -id[1])
+        return found;
+    found.reset();
+
+    const bool rankZeroOnly = prepare ? prepare() : false;
+
+    const double startTime = MPI_Wtime();
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // a new id from comm rank 0, unique over all processes
+    if (rank == 0) {
+        int worldRank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &worldRank);
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        id[0] = (static_cast<long long>(worldRank) << 32) + (++serial);
+    }
+    MPI_Bcast(id, 1, MPI_LONG_LONG, 0, comm);
+
+    // ranks sharing memory with this rank, comm rank 0 is always a node leader
+    MPI_Comm nodeComm = splitNode(comm);
+    int nodeRank;
+    MPI_Comm_rank(nodeComm, &nodeRank);
+    const bool leader = (nodeRank == 0);
+
+    // one communicator with all node leaders
+    MPI_Comm leaderComm;
+    MPI_Comm_split(comm, leader ? 0 : MPI_UNDEFINED, rank, &leaderComm);
+
+    const bool perNode = readOnEveryNode() && !rankZeroOnly;
+    const bool reader = perNode ? leader : (rank == 0);
+
+    // reader(s) load from the file system
+    std::shared_ptr<const OperatorMatrix> local;
+    int dims[2] = {0, 0};
+    if (reader) {
+        local = loader();
+        dims[0] = local->getRows();
+        dims[1] = local->getCols();
+    }
+    const double loadTime = MPI_Wtime() - startTime;
+    if (perNode)
+        MPI_Bcast(dims, 2, MPI_INT, 0, nodeComm);
+    else
+        MPI_Bcast(dims, 2, MPI_INT, 0, comm);
+
+    // with a reader on each node, a mmap()ed binary file is shared through the page cache.
+    // every rank on the node maps it, nothing is copied and pages are read on first use
+    std::shared_ptr<const OperatorMatrix> mat;
+    if (perNode) {
+        std::string file = reader ? local->getFile() : std::string();
+        int length = file.size();
+        MPI_Bcast(&length, 1, MPI_INT, 0, nodeComm);
+        if (length > 0) {
+            file.resize(length);
+            MPI_Bcast(&file[0], length, MPI_CHAR, 0, nodeComm);
+            auto view = std::make_shared<OperatorMatrix>();
+            int ok = leader || view->map(file, dims[0], dims[1]);
+            MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, nodeComm);
+            if (ok)
+                mat = leader ? local : view;
+        }
+    }
+    const bool mapped = (mat != nullptr);
+
+    if (mapped) {
+        local.reset();
+        MPI_Comm_free(&nodeComm);
+    } else {
+        // one copy per node in a shared memory window owned by the leader
+        const std::size_t count = std::size_t(dims[0]) * dims[1];
+        const MPI_Aint bytes = leader ? MPI_Aint(count * sizeof(double)) : 0;
+        double *base = nullptr;
+        MPI_Win win;
+        MPI_Win_allocate_shared(bytes, sizeof(double), MPI_INFO_NULL, nodeComm, &base, &win);
+        MPI_Win_fence(0, win);
+        if (reader) {
+            std::memcpy(base, local->data(), count * sizeof(double));
+            local.reset();
+        }
+        if (!perNode && leader) {
+            // rank 0 sends to the other node leaders, in chunks to keep counts in int range
+            constexpr std::size_t chunk = std::size_t(1) << 27;
+            for (std::size_t offset = 0; offset < count; offset += chunk) {
+                const int n = std::min(chunk, count - offset);
+                MPI_Bcast(base + offset, n, MPI_DOUBLE, 0, leaderComm);
+            }
+        }
+        MPI_Win_fence(0, win);
+
+        MPI_Aint size;
+        int dispUnit;
+        MPI_Win_shared_query(win, 0, &size, &dispUnit, &base);
+
+        mat = std::make_shared<OperatorMatrix>(dims[0], dims[1], base, [win, nodeComm]() mutable {
+            int finalized;
+            MPI_Finalized(&finalized);
+            if (!finalized) {
+                MPI_Win_free(&win);
+                MPI_Comm_free(&nodeComm);
+            }
+        });
+    }
+    if (leaderComm != MPI_COMM_NULL)
+        MPI_Comm_free(&leaderComm);
+
+    // report the slowest rank
+    double time[2] = {loadTime, MPI_Wtime() - startTime - loadTime};
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : time, time, 2, MPI_DOUBLE, MPI_MAX, 0, comm);
+    if (stkfmm::verbose && rank == 0) {
+        std::cout << name << " loaded by " << (perNode ? "node leaders" : "rank 0") << (mapped ? ", mapped" : "")
+                  << ", read " << time[0] << " s, distribute " << time[1] << " s" << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    cache[id[0]] = Entry{name, mat};
+    latest[name] = id[0];
+    return mat;
+}
+
+void OperatorCache::release() {
+    int finalized;
+    MPI_Finalized(&finalized);
+    if (finalized)
+        return;
+
+    std::vector<long long> ids;
+    std::vector<int> unused;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        for (const auto &entry : cache) {
+            ids.push_back(entry.first);
+            unused.push_back(entry.second.mat.use_count() == 1);
+        }
+    }
+    if (ids.empty())
+        return;
+
+    // free an entry only if it is unused on every rank
+    MPI_Allreduce(MPI_IN_PLACE, unused.data(), unused.size(), MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+
+    std::vector<std::shared_ptr<const OperatorMatrix>> freed;
+    {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        for (std::size_t i = 0; i < ids.size(); i++) {
+            if (!unused[i])
+                continue;
+            auto it = cache.find(ids[i]);
+            auto last = latest.find(it->second.name);
+            if (last != latest.end() && last->second == ids[i])
+                latest.erase(last);
+            freed.push_back(std::move(it->second.mat));
+            cache.erase(it);
+        }
+    }
+    // MPI_Win_free and MPI_Comm_free run here, in id order, without the lock
+    freed.clear();
+}
+
+std::size_t OperatorCache::bytes() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    std::size_t n = 0;
+    for (const auto &entry : cache)
+        n += entry.second.mat->size() * sizeof(double);
+    return n;
+}
+
+} // namespace impl
+} // namespace stkfmm
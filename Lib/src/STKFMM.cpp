@@ -1,5 +1,10 @@
 #include "STKFMM/STKFMM.hpp"
 
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <thread>
+
 // extern pvfmm::PeriodicType pvfmm::periodicType;
 
 namespace stkfmm {
@@ -27,9 +32,42 @@ const std::unordered_map<KERNEL, const pvfmm::Kernel<double> *> kernelMap = {
     {KERNEL::PVelGrad, &pvfmm::StokesLayerKernel<double>::PVelGrad()},
     {KERNEL::PVelLaplacian, &pvfmm::StokesLayerKernel<double>::PVelLaplacian()},
     {KERNEL::Traction, &pvfmm::StokesLayerKernel<double>::Traction()},
+    {KERNEL::RPYWall, &pvfmm::RPYWallKernel<double>::ulapu()},
+    {KERNEL::StokesLapPGrad, &pvfmm::StokesLaplaceKernel<double>::VelPGrad()},
+    {KERNEL::PVelTraction, &pvfmm::StokesLayerKernel<double>::PVelTraction()},
+    {KERNEL::StokesBatch, &pvfmm::BatchKernel<double>::StokesVel()},
+    {KERNEL::RPYBatch, &pvfmm::BatchKernel<double>::RPYULapU()},
+    {KERNEL::LapPGradBatch, &pvfmm::BatchKernel<double>::LapPGrad()},
     // {KERNEL::LapGrad, &pvfmm::LaplaceLayerKernel<double>::Grad()}, // for internal test only
 };
 
+const std::unordered_map<KERNEL, const pvfmm::Kernel<float> *> kernelMapFloat = {
+    {KERNEL::LapPGrad, &pvfmm::LaplaceLayerKernel<float>::PGrad()},
+    {KERNEL::LapPGradGrad, &pvfmm::LaplaceLayerKernel<float>::PGradGrad()},
+    {KERNEL::LapQPGradGrad, &pvfmm::LaplaceLayerKernel<float>::QPGradGrad()},
+    {KERNEL::Stokes, &pvfmm::StokesLayerKernel<float>::Vel()},
+    {KERNEL::RPY, &pvfmm::RPYKernel<float>::ulapu()},
+    {KERNEL::StokesRegVel, &pvfmm::StokesRegKernel<float>::Vel()},
+    {KERNEL::StokesRegVelOmega, &pvfmm::StokesRegKernel<float>::FTVelOmega()},
+    {KERNEL::PVel, &pvfmm::StokesLayerKernel<float>::PVel()},
+    {KERNEL::PVelGrad, &pvfmm::StokesLayerKernel<float>::PVelGrad()},
+    {KERNEL::PVelLaplacian, &pvfmm::StokesLayerKernel<float>::PVelLaplacian()},
+    {KERNEL::Traction, &pvfmm::StokesLayerKernel<float>::Traction()},
+    {KERNEL::RPYWall, &pvfmm::RPYWallKernel<float>::ulapu()},
+    {KERNEL::StokesLapPGrad, &pvfmm::StokesLaplaceKernel<float>::VelPGrad()},
+    {KERNEL::PVelTraction, &pvfmm::StokesLayerKernel<float>::PVelTraction()},
+    {KERNEL::StokesBatch, &pvfmm::BatchKernel<float>::StokesVel()},
+    {KERNEL::RPYBatch, &pvfmm::BatchKernel<float>::RPYULapU()},
+    {KERNEL::LapPGradBatch, &pvfmm::BatchKernel<float>::LapPGrad()},
+};
+
+// PVel kernels are not batched, the PXYZ net flux correction is computed from a single density
+const std::unordered_map<KERNEL, KERNEL> batchKernelMap = {
+    {KERNEL::Stokes, KERNEL::StokesBatch},
+    {KERNEL::RPY, KERNEL::RPYBatch},
+    {KERNEL::LapPGrad, KERNEL::LapPGradBatch},
+};
+
 std::tuple<int, int, int> getKernelDimension(KERNEL kernel_) {
     using namespace impl;
     const pvfmm::Kernel<double> *kernelFunctionPtr = getKernelFunction(kernel_);
@@ -45,6 +83,27 @@ std::string getKernelName(KERNEL kernel_) {
     return kernelFunctionPtr->ker_name;
 }
 
+std::string getPhaseName(PHASE phase_) {
+    switch (phase_) {
+    case PHASE::INGEST:
+        return "ingest";
+    case PHASE::TREEBUILD:
+        return "treeBuild";
+    case PHASE::SETUPFMM:
+        return "setupFMM";
+    case PHASE::FMM:
+        return "fmm";
+    case PHASE::PERIODIZE:
+        return "periodize";
+    case PHASE::SCALING:
+        return "scaling";
+    case PHASE::COPYOUT:
+        return "copyOut";
+    default:
+        return "unknown";
+    }
+}
+
 const pvfmm::Kernel<double> *getKernelFunction(KERNEL kernelChoice_) {
     auto it = kernelMap.find(kernelChoice_);
     if (it != kernelMap.end()) {
@@ -56,17 +115,70 @@ const pvfmm::Kernel<double> *getKernelFunction(KERNEL kernelChoice_) {
     }
 }
 
+/**
+ * @brief typical relative L2 error and fastest leaf size at each even multipole order
+ * potentials of random points in free space, regenerate with Config/OrderSweep.py
+ */
+struct OrderData {
+    int multOrder;
+    double error;
+    int maxPts;
+};
+static const std::vector<OrderData> orderTable = {
+    {6, 3e-4, 500},   {8, 3e-5, 1000},  {10, 3e-6, 1500},
+    {12, 3e-7, 2000}, {14, 3e-8, 3000}, {16, 3e-9, 4000},
+};
+
+/**
+ * @brief kernels with gradient or laplacian outputs lose about one digit
+ */
+static double kernelErrorFactor(KERNEL kernel) {
+    switch (kernel) {
+    case KERNEL::Stokes:
+    case KERNEL::StokesRegVel:
+    case KERNEL::PVel:
+        return 1;
+    default:
+        return 10;
+    }
+}
+
+FMMParameters chooseParameters(const double tolerance, const unsigned int kernelComb, const PRECISION precision) {
+    double factor = 1;
+    for (const auto &it : kernelMap) {
+        if (kernelComb & asInteger(it.first))
+            factor = std::max(factor, kernelErrorFactor(it.first));
+    }
+
+    // single precision translation operators stop converging beyond order 8
+    const int maxOrder = precision == PRECISION::FLOAT ? 8 : 16;
+
+    FMMParameters param{0, 0, 0};
+    for (const auto &data : orderTable) {
+        if (data.multOrder > maxOrder)
+            break;
+        param.multOrder = data.multOrder;
+        param.maxPts = data.maxPts;
+        param.expectedError = data.error * factor;
+        if (param.expectedError <= tolerance)
+            break;
+    }
+    return param;
+}
+
 // base class STKFMM
 
-STKFMM::STKFMM(int multOrder_, int maxPts_, PAXIS pbc_, unsigned int kernelComb_, bool enableFF_)
-    : multOrder(multOrder_), maxPts(maxPts_), pbc(pbc_), kernelComb(kernelComb_) {
+STKFMM::STKFMM(int multOrder_, int maxPts_, PAXIS pbc_, unsigned int kernelComb_, bool enableFF_,
+               PRECISION precision_)
+    : multOrder(multOrder_), maxPts(maxPts_), pbc(pbc_), kernelComb(kernelComb_), enableFF(enableFF_),
+      precision(precision_) {
     using namespace impl;
 
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
 #ifdef FMMDEBUG
     pvfmm::Profile::Enable(true);
-    if (myRank == 0)
+    if (rank == 0)
         printf("FMM Initialized\n");
 #endif
 }
@@ -85,6 +197,98 @@ void STKFMM::setBox(double origin_[3], double len_) {
     }
 };
 
+bool STKFMM::updatePoints(const int nSL, const double *srcSLCoordPtr, const int nTrg, const double *trgCoordPtr,
+                          const int nDL, const double *srcDLCoordPtr) {
+    // no way to keep the trees, always rebuild
+    setPoints(nSL, srcSLCoordPtr, nTrg, trgCoordPtr, nDL, srcDLCoordPtr);
+    return false;
+}
+
+void STKFMM::setAsyncThreads(int nSetupThreads, int nEvalThreads) {
+    asyncThreads[0] = nSetupThreads;
+    asyncThreads[1] = nEvalThreads;
+}
+
+std::future<void> STKFMM::setupTreeAsync(KERNEL kernel) {
+    if (!setupQueue) {
+        const int nThreads = asyncThreads[0] > 0 ? asyncThreads[0] : std::max(omp_get_max_threads() / 2, 1);
+        setupQueue.reset(new impl::TaskQueue(nThreads));
+    }
+    // the destructor joins the worker before this object goes away
+    return setupQueue->submit([this, kernel]() { setupTree(kernel); });
+}
+
+std::future<void> STKFMM::evaluateFMMAsync(const KERNEL kernel, const int nSL, const double *srcSLValuePtr,
+                                           const int nTrg, double *trgValuePtr, const int nDL,
+                                           const double *srcDLValuePtr, const EVALMODE mode) {
+    if (!evalQueue) {
+        const int nThreads = asyncThreads[1] > 0 ? asyncThreads[1] : std::max(omp_get_max_threads() / 2, 1);
+        evalQueue.reset(new impl::TaskQueue(nThreads));
+    }
+    return evalQueue->submit([=]() {
+        evaluateFMM(kernel, nSL, srcSLValuePtr, nTrg, trgValuePtr, nDL, srcDLValuePtr, mode);
+    });
+}
+
+void STKFMM::evaluateFMM(const std::vector<KERNEL> &kernels, const int nSL,
+                         const std::vector<const double *> &srcSLValuePtrs, const int nTrg,
+                         const std::vector<double *> &trgValuePtrs, const int nDL,
+                         const std::vector<const double *> &srcDLValuePtrs, const EVALMODE mode) {
+    const size_t nKernel = kernels.size();
+    if (srcSLValuePtrs.size() != nKernel || trgValuePtrs.size() != nKernel ||
+        !(srcDLValuePtrs.empty() || srcDLValuePtrs.size() == nKernel)) {
+        std::cout << "Error: number of value arrays does not match number of kernels\n";
+        exit(1);
+    }
+    const std::vector<const double *> srcDLPtrs =
+        srcDLValuePtrs.empty() ? std::vector<const double *>(nKernel, nullptr) : srcDLValuePtrs;
+
+    std::vector<bool> done(nKernel, false);
+    evaluateFused(kernels, nSL, srcSLValuePtrs, nTrg, trgValuePtrs, nDL, srcDLPtrs, mode, done);
+
+    for (size_t k = 0; k < nKernel; k++) {
+        if (done[k])
+            continue;
+        setupTree(kernels[k]);
+        evaluateFMM(kernels[k], nSL, srcSLValuePtrs[k], nTrg, trgValuePtrs[k], nDL, srcDLPtrs[k], mode);
+    }
+}
+
+void STKFMM::evaluateFMMBatch(const KERNEL kernel, const int nRHS, const int nSL, const double *srcSLValuePtr,
+                              const int nTrg, double *trgValuePtr, const int nDL, const double *srcDLValuePtr,
+                              const EVALMODE mode) {
+    int kdimSL, kdimDL, kdimTrg;
+    std::tie(kdimSL, kdimDL, kdimTrg) = getKernelDimension(kernel);
+
+    // one set at a time through contiguous copies, evaluateFMM() may use the internal value buffers
+    std::vector<double> srcSL(nSL * kdimSL), srcDL(srcDLValuePtr ? nDL * kdimDL : 0), trg(nTrg * kdimTrg);
+    auto gather = [&](const int n, const int kdim, const double *from, const int r, std::vector<double> &to) {
+#pragma omp parallel for
+        for (int i = 0; i < n; i++)
+            std::copy_n(from + (nRHS * i + r) * kdim, kdim, to.data() + kdim * i);
+    };
+    setupTree(kernel);
+    for (int r = 0; r < nRHS; r++) {
+        gather(nSL, kdimSL, srcSLValuePtr, r, srcSL);
+        if (srcDLValuePtr)
+            gather(nDL, kdimDL, srcDLValuePtr, r, srcDL);
+        evaluateFMM(kernel, nSL, srcSL.data(), nTrg, trg.data(), nDL, srcDLValuePtr ? srcDL.data() : nullptr,
+                    EVALMODE::OVERWRITE);
+        const bool overwrite = (mode == EVALMODE::OVERWRITE);
+#pragma omp parallel for
+        for (int i = 0; i < nTrg; i++) {
+            double *out = trgValuePtr + (nRHS * i + r) * kdimTrg;
+            for (int j = 0; j < kdimTrg; j++)
+                out[j] = overwrite ? trg[kdimTrg * i + j] : out[j] + trg[kdimTrg * i + j];
+        }
+    }
+}
+
+void STKFMM::stopAsync() {
+    setupQueue.reset();
+    evalQueue.reset();
+}
+
 void STKFMM::evaluateKernel(const KERNEL kernel, const int nThreads, const PPKERNEL p2p, const int nSrc,
                             double *srcCoordPtr, double *srcValuePtr, const int nTrg, double *trgCoordPtr,
                             double *trgValuePtr) {
@@ -93,9 +297,10 @@ void STKFMM::evaluateKernel(const KERNEL kernel, const int nThreads, const PPKER
         std::cout << "Error: no such FMMData exists for kernel " << getKernelName(kernel) << std::endl;
         exit(1);
     }
-    FMMData &fmm = *((*poolFMM.find(kernel)).second);
 
-    fmm.evaluateKernel(nThreads, p2p, nSrc, srcCoordPtr, srcValuePtr, nTrg, trgCoordPtr, trgValuePtr);
+    // the FMMData may run a different kernel, e.g. RPY of StkWallFMM runs the fused image kernel RPYWall
+    FMMData::evaluateKernel(getKernelFunction(kernel), nThreads, p2p, nSrc, srcCoordPtr, srcValuePtr, nTrg,
+                            trgCoordPtr, trgValuePtr);
 }
 
 void STKFMM::showActiveKernels() const {
@@ -110,6 +315,183 @@ void STKFMM::showActiveKernels() const {
     }
 }
 
+void STKFMM::initializeKernels() {
+    using namespace impl;
+    // in kernelMap order, the same on all ranks
+    std::vector<FMMData *> pending;
+    for (const auto &it : kernelMap) {
+        auto fmm = poolFMM.find(it.first);
+        if (fmm != poolFMM.end() && !fmm->second->isInitialized())
+            pending.push_back(fmm->second);
+    }
+
+    // tuning maxPts needs all threads
+    int provided;
+    MPI_Query_thread(&provided);
+    const bool concurrent = pending.size() > 1 && provided == MPI_THREAD_MULTIPLE && maxPts > 0;
+    if (!concurrent) {
+        for (auto fmm : pending)
+            fmm->initialize();
+        return;
+    }
+
+    for (auto fmm : pending)
+        fmm->prepare();
+
+    // kernels with the same far-field kernels share the operators of the first one, initialize it first
+    std::set<std::string> farField;
+    std::vector<std::function<void()>> leaders, followers;
+    for (auto fmm : pending) {
+        auto &tasks = farField.insert(fmm->farFieldName()).second ? leaders : followers;
+        tasks.push_back([fmm]() { fmm->initialize(); });
+    }
+    runConcurrently(leaders);
+    runConcurrently(followers);
+}
+
+void STKFMM::runConcurrently(const std::vector<std::function<void()>> &tasks) {
+    int provided;
+    MPI_Query_thread(&provided);
+    if (tasks.size() < 2 || provided != MPI_THREAD_MULTIPLE) {
+        for (const auto &task : tasks)
+            task();
+        return;
+    }
+
+    // each FMMData has its own communicator, so collectives on different threads do not mix
+    const int nThreads = std::max(omp_get_max_threads() / static_cast<int>(tasks.size()), 1);
+    std::vector<std::thread> workers;
+    for (const auto &task : tasks) {
+        workers.emplace_back([&task, nThreads]() {
+            omp_set_num_threads(nThreads);
+            task();
+        });
+    }
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void STKFMM::setCostWeighted(bool costWeighted_) {
+    for (auto &fmm : poolFMM) {
+        fmm.second->costWeighted = costWeighted_;
+    }
+}
+
+void STKFMM::setImbalanceThreshold(double threshold) { imbalanceThreshold = threshold; }
+
+void STKFMM::releaseOperators() { impl::OperatorCache::release(); }
+
+double STKFMM::getImbalance(KERNEL kernel) {
+    using namespace impl;
+    if (poolFMM.find(kernel) == poolFMM.end()) {
+        std::cout << "Error: no such FMMData exists for kernel " << getKernelName(kernel) << std::endl;
+        exit(1);
+    }
+    return poolFMM.find(kernel)->second->getImbalance();
+}
+
+/**
+ * @brief min, max and sum over ranks of a struct of std::size_t fields
+ */
+template <class Usage, class Report>
+static Report reduceUsage(const Usage &usage) {
+    constexpr int nField = sizeof(Usage) / sizeof(std::size_t);
+    static_assert(sizeof(std::size_t) == sizeof(unsigned long long), "memory usage reduced as unsigned long long");
+    Report report;
+    MPI_Allreduce(&usage, &report.min, nField, MPI_UNSIGNED_LONG_LONG, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(&usage, &report.max, nField, MPI_UNSIGNED_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(&usage, &report.sum, nField, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    return report;
+}
+
+MemoryReport STKFMM::getMemoryUsage(KERNEL kernel) const {
+    using namespace impl;
+    if (poolFMM.find(kernel) == poolFMM.end()) {
+        std::cout << "Error: no such FMMData exists for kernel " << getKernelName(kernel) << std::endl;
+        exit(1);
+    }
+    const MemoryUsage usage = poolFMM.find(kernel)->second->getMemoryUsage();
+    return reduceUsage<MemoryUsage, MemoryReport>(usage);
+}
+
+ProcessMemoryReport STKFMM::getMemoryUsage() const {
+    using namespace impl;
+    ProcessMemoryUsage usage;
+    usage.operators = operatorResidentBytes();
+    usage.periodic = OperatorCache::bytes();
+    usage.internal = internalBytes();
+    usage.peakResident = peakResidentBytes();
+    return reduceUsage<ProcessMemoryUsage, ProcessMemoryReport>(usage);
+}
+
+PerfReport STKFMM::getPerfCounters(KERNEL kernel) const {
+    using namespace impl;
+    if (poolFMM.find(kernel) == poolFMM.end()) {
+        std::cout << "Error: no such FMMData exists for kernel " << getKernelName(kernel) << std::endl;
+        exit(1);
+    }
+    const PerfCounters &perf = poolFMM.find(kernel)->second->perf;
+
+    int nProcs;
+    MPI_Comm_size(MPI_COMM_WORLD, &nProcs);
+    PerfReport report;
+    MPI_Allreduce(perf.seconds, report.min, NPHASE, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(perf.seconds, report.max, NPHASE, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(perf.seconds, report.avg, NPHASE, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    for (int i = 0; i < NPHASE; i++)
+        report.avg[i] /= nProcs;
+    report.setupCalls = perf.setupCalls;
+    report.evaluateCalls = perf.evaluateCalls;
+    return report;
+}
+
+void STKFMM::resetPerfCounters() {
+    for (auto &fmm : poolFMM)
+        fmm.second->perf = PerfCounters();
+    impl::resetPeakResident();
+}
+
+void STKFMM::dumpPerfCounters(const std::string &file) const {
+    // the same order on all ranks
+    std::vector<KERNEL> kernels;
+    for (const auto &fmm : poolFMM)
+        kernels.push_back(fmm.first);
+    std::sort(kernels.begin(), kernels.end(), [](KERNEL a, KERNEL b) { return asInteger(a) < asInteger(b); });
+
+    std::vector<PerfReport> reports;
+    for (auto kernel : kernels)
+        reports.push_back(getPerfCounters(kernel));
+    if (rank != 0)
+        return;
+
+    int nProcs;
+    MPI_Comm_size(MPI_COMM_WORLD, &nProcs);
+    std::ofstream fout(file);
+    if (!fout) {
+        std::cout << "cannot open " << file << " for writing" << std::endl;
+        return;
+    }
+    fout << "{\n  \"nProcs\": " << nProcs << ",\n  \"nThreads\": " << omp_get_max_threads()
+         << ",\n  \"kernels\": {";
+    for (size_t k = 0; k < kernels.size(); k++) {
+        const PerfReport &report = reports[k];
+        fout << (k ? "," : "") << "\n    \"" << getKernelName(kernels[k]) << "\": {\n      \"setupCalls\": "
+             << report.setupCalls << ",\n      \"evaluateCalls\": " << report.evaluateCalls;
+        for (int i = 0; i < NPHASE; i++) {
+            fout << ",\n      \"" << getPhaseName(static_cast<PHASE>(i)) << "\": {\"min\": " << report.min[i]
+                 << ", \"avg\": " << report.avg[i] << ", \"max\": " << report.max[i] << "}";
+        }
+        fout << "\n    }";
+    }
+    fout << "\n  }\n}\n";
+}
+
+std::size_t STKFMM::internalBytes() const {
+    return (srcSLCoordInternal.capacity() + srcDLCoordInternal.capacity() + trgCoordInternal.capacity() +
+            srcSLValueInternal.capacity() + srcDLValueInternal.capacity() + trgValueInternal.capacity()) *
+           sizeof(double);
+}
+
 void STKFMM::scaleCoord(const int npts, double *coordPtr) const {
     // scale and shift points to [0,1)
     const double sF = this->scaleFactor;
@@ -122,6 +504,10 @@ void STKFMM::scaleCoord(const int npts, double *coordPtr) const {
     }
 }
 
+bool STKFMM::sharedPoints(const int nSL, const double *srcSLCoordPtr, const int nTrg, const double *trgCoordPtr) {
+    return nSL == nTrg && srcSLCoordPtr == trgCoordPtr;
+}
+
 void STKFMM::wrapCoord(const int npts, double *coordPtr) const {
     // wrap periodic images
     if (pbc == PAXIS::PX) {
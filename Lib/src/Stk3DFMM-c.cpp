@@ -15,6 +15,11 @@ extern "C" {
         fmm->setPoints(nSL, src_SL_coord, nTrg, trg_coord, nDL, src_DL_coord);
     }
 
+    int Stk3DFMM_update_points(Stk3DFMM *fmm, const int nSL, double *src_SL_coord, const int nTrg, double *trg_coord,
+                               const int nDL, double *src_DL_coord) {
+        return fmm->updatePoints(nSL, src_SL_coord, nTrg, trg_coord, nDL, src_DL_coord);
+    }
+
     void Stk3DFMM_get_kernel_dimension(unsigned kernel, int *dims) {
         std::tie(dims[0], dims[1], dims[2]) = getKernelDimension(static_cast<KERNEL>(kernel));
     }
@@ -30,10 +35,28 @@ extern "C" {
         fmm->evaluateFMM(static_cast<KERNEL>(kernel), nSL, src_SL_value, nTrg, trg_value, nDL, src_DL_value);
     }
 
+    void Stk3DFMM_evaluate_fmm_batch(Stk3DFMM *fmm, unsigned kernel, const int nRHS, const int nSL,
+                                     double *src_SL_value, const int nTrg, double *trg_value, const int nDL,
+                                     double *src_DL_value) {
+        fmm->evaluateFMMBatch(static_cast<KERNEL>(kernel), nRHS, nSL, src_SL_value, nTrg, trg_value, nDL,
+                              src_DL_value);
+    }
+
     void Stk3DFMM_show_active_kernels(Stk3DFMM *fmm) {
         fmm->showActiveKernels();
     }
 
+    void Stk3DFMM_get_perf_counters(Stk3DFMM *fmm, unsigned kernel, double *min, double *avg, double *max) {
+        PerfReport report = fmm->getPerfCounters(static_cast<KERNEL>(kernel));
+        std::copy(report.min, report.min + NPHASE, min);
+        std::copy(report.avg, report.avg + NPHASE, avg);
+        std::copy(report.max, report.max + NPHASE, max);
+    }
+
+    void Stk3DFMM_reset_perf_counters(Stk3DFMM *fmm) { fmm->resetPerfCounters(); }
+
+    void Stk3DFMM_dump_perf_counters(Stk3DFMM *fmm, const char *file) { fmm->dumpPerfCounters(file); }
+
     StkWallFMM *StkWallFMM_create(int mult_order, int max_pts, int pbc, unsigned kernelComb) {
         return new StkWallFMM(mult_order, max_pts, static_cast<PAXIS>(pbc), kernelComb);
     }
@@ -62,7 +85,27 @@ extern "C" {
         fmm->evaluateFMM(static_cast<KERNEL>(kernel), nSL, src_SL_value, nTrg, trg_value, nDL, src_DL_value);
     }
 
+    void StkWallFMM_evaluate_fmm_batch(StkWallFMM *fmm, unsigned kernel, const int nRHS, const int nSL,
+                                       double *src_SL_value, const int nTrg, double *trg_value, const int nDL,
+                                       double *src_DL_value) {
+        fmm->evaluateFMMBatch(static_cast<KERNEL>(kernel), nRHS, nSL, src_SL_value, nTrg, trg_value, nDL,
+                              src_DL_value);
+    }
+
     void StkWallFMM_show_active_kernels(StkWallFMM *fmm) {
         fmm->showActiveKernels();
     }
+
+    void StkWallFMM_get_perf_counters(StkWallFMM *fmm, unsigned kernel, double *min, double *avg, double *max) {
+        PerfReport report = fmm->getPerfCounters(static_cast<KERNEL>(kernel));
+        std::copy(report.min, report.min + NPHASE, min);
+        std::copy(report.avg, report.avg + NPHASE, avg);
+        std::copy(report.max, report.max + NPHASE, max);
+    }
+
+    void StkWallFMM_reset_perf_counters(StkWallFMM *fmm) { fmm->resetPerfCounters(); }
+
+    void StkWallFMM_dump_perf_counters(StkWallFMM *fmm, const char *file) { fmm->dumpPerfCounters(file); }
+
+    void STKFMM_release_operators() { STKFMM::releaseOperators(); }
 }
@@ -1,28 +1,44 @@
 #include "STKFMM/STKFMM.hpp"
 #include <stdlib.h>
 
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
 namespace stkfmm {
 
-Stk3DFMM::Stk3DFMM(int multOrder_, int maxPts_, PAXIS pbc_, unsigned int kernelComb_, bool enableFF_)
-    : STKFMM(multOrder_, maxPts_, pbc_, kernelComb_) {
-    using namespace impl;
+Stk3DFMM::Stk3DFMM(int multOrder_, int maxPts_, PAXIS pbc_, unsigned int kernelComb_, bool enableFF_,
+                   PRECISION precision_)
+    : STKFMM(multOrder_, maxPts_, pbc_, kernelComb_, enableFF_, precision_) {
     poolFMM.clear();
+    Stk3DFMM::enableKernels(kernelComb);
 
+    if (poolFMM.empty()) {
+        std::cout << "Error: no kernel activated\n";
+    }
+}
+
+void Stk3DFMM::enableKernels(unsigned int kernelComb_) {
+    using namespace impl;
+    // pvfmm operators are initialized at the first setupTree()
     for (const auto &it : kernelMap) {
         const auto kernel = it.first;
-        if (kernelComb & asInteger(kernel)) {
-            poolFMM[kernel] = new FMMData(kernel, pbc, multOrder, maxPts, enableFF_);
+        // internal kernels, the fused ones are created by evaluateFused(), the batched ones by evaluateFMMBatch()
+        if (kernel == KERNEL::RPYWall || kernel == KERNEL::StokesLapPGrad || kernel == KERNEL::PVelTraction ||
+            kernel == KERNEL::StokesBatch || kernel == KERNEL::RPYBatch || kernel == KERNEL::LapPGradBatch)
+            continue;
+        if ((kernelComb_ & asInteger(kernel)) && poolFMM.find(kernel) == poolFMM.end()) {
+            poolFMM[kernel] = new FMMData(kernel, pbc, multOrder, maxPts, enableFF, precision);
             if (!rank)
                 std::cout << "enable kernel " << it.second->ker_name << std::endl;
         }
     }
-
-    if (poolFMM.empty()) {
-        std::cout << "Error: no kernel activated\n";
-    }
+    kernelComb |= kernelComb_;
 }
 
 Stk3DFMM::~Stk3DFMM() {
+    stopAsync();
     // delete all FMMData
     for (auto &fmm : poolFMM) {
         safeDeletePtr(fmm.second);
@@ -31,6 +47,7 @@ Stk3DFMM::~Stk3DFMM() {
 
 void Stk3DFMM::setPoints(const int nSL, const double *srcSLCoordPtr, const int nTrg, const double *trgCoordPtr,
                          const int nDL, const double *srcDLCoordPtr) {
+    const double startTime = MPI_Wtime();
 
     if (!poolFMM.empty()) {
         for (auto &fmm : poolFMM) {
@@ -42,6 +59,57 @@ void Stk3DFMM::setPoints(const int nSL, const double *srcSLCoordPtr, const int n
             std::cout << "ALL FMM Tree Cleared\n";
     }
 
+    storePoints(nSL, srcSLCoordPtr, nTrg, trgCoordPtr, nDL, srcDLCoordPtr);
+
+    // shared by all kernels
+    const double ingestTime = MPI_Wtime() - startTime;
+    for (auto &fmm : poolFMM)
+        fmm.second->perf.seconds[asInteger(PHASE::INGEST)] += ingestTime;
+
+    if (stkfmm::verbose && rank == 0)
+        std::cout << "points set\n";
+}
+
+bool Stk3DFMM::updatePoints(const int nSL, const double *srcSLCoordPtr, const int nTrg, const double *trgCoordPtr,
+                            const int nDL, const double *srcDLCoordPtr) {
+    // the trees hold the points of the last setPoints(), the same number on all ranks is needed to keep them
+    const int nDLInternal = srcDLCoordInternal.size() / 3;
+    int samePoints = nSL == static_cast<int>(srcSLCoordInternal.size() / 3) && nTrg == nTrgInternal &&
+                     (nDL > 0 && srcDLCoordPtr != nullptr ? nDL : 0) == nDLInternal &&
+                     sharedPoints(nSL, srcSLCoordPtr, nTrg, trgCoordPtr) == trgIsSrcSL;
+    MPI_Allreduce(MPI_IN_PLACE, &samePoints, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!samePoints) {
+        setPoints(nSL, srcSLCoordPtr, nTrg, trgCoordPtr, nDL, srcDLCoordPtr);
+        return false;
+    }
+
+    const double startTime = MPI_Wtime();
+    storePoints(nSL, srcSLCoordPtr, nTrg, trgCoordPtr, nDL, srcDLCoordPtr);
+    const double ingestTime = MPI_Wtime() - startTime;
+    for (auto &fmm : poolFMM)
+        fmm.second->perf.seconds[asInteger(PHASE::INGEST)] += ingestTime;
+
+    // trees are set up for the same kernels on all ranks, updated in the same order
+    int nRebuild = 0;
+    for (auto &fmm : poolFMM) {
+        auto &fmmPtr = fmm.second;
+        if (!fmmPtr->hasTree())
+            continue;
+        const int nDLTree = fmmPtr->hasDL() ? nDLInternal : 0;
+        if (!fmmPtr->updateTree(nSL, srcSLCoordInternal.data(), nDLTree, srcDLCoordInternal.data(), nTrgInternal,
+                                trgCoordData(), imbalanceThreshold)) {
+            fmmPtr->deleteTree();
+            nRebuild++;
+        }
+    }
+
+    if (stkfmm::verbose && rank == 0)
+        std::cout << "points updated, " << nRebuild << " FMM trees to rebuild\n";
+    return nRebuild == 0;
+}
+
+void Stk3DFMM::storePoints(const int nSL, const double *srcSLCoordPtr, const int nTrg, const double *trgCoordPtr,
+                           const int nDL, const double *srcDLCoordPtr) {
     // setup point coordinates
     auto setCoord = [&](const int nPts, const double *coordPtr, std::vector<double> &coord) {
         coord.resize(nPts * 3);
@@ -50,6 +118,14 @@ void Stk3DFMM::setPoints(const int nSL, const double *srcSLCoordPtr, const int n
         wrapCoord(nPts, coord.data());
     };
 
+    // targets that are the SL sources are stored once
+    trgIsSrcSL = sharedPoints(nSL, srcSLCoordPtr, nTrg, trgCoordPtr);
+    nTrgInternal = nTrg;
+    if (trgIsSrcSL) {
+        trgCoordInternal.clear();
+        trgCoordInternal.shrink_to_fit();
+    }
+
 #pragma omp parallel sections
     {
 #pragma omp section
@@ -60,25 +136,26 @@ void Stk3DFMM::setPoints(const int nSL, const double *srcSLCoordPtr, const int n
                 setCoord(nDL, srcDLCoordPtr, srcDLCoordInternal);
         }
 #pragma omp section
-        { setCoord(nTrg, trgCoordPtr, trgCoordInternal); }
+        {
+            if (!trgIsSrcSL)
+                setCoord(nTrg, trgCoordPtr, trgCoordInternal);
+        }
     }
-
-    if (stkfmm::verbose && rank == 0)
-        std::cout << "points set\n";
 }
 
 void Stk3DFMM::setupTree(KERNEL kernel) {
     auto &fmmPtr = poolFMM[kernel];
-    if (fmmPtr->hasDL()) {
-        poolFMM[kernel]->setupTree(srcSLCoordInternal, srcDLCoordInternal, trgCoordInternal);
-    } else {
-        std::vector<double> empty;
-        poolFMM[kernel]->setupTree(srcSLCoordInternal, empty, trgCoordInternal);
+    if (fmmPtr->hasTree()) {
+        // points not changed since the last setupTree(), or moved within their leaves by updatePoints()
+        return;
     }
+    const int nSL = srcSLCoordInternal.size() / 3;
+    const int nDL = fmmPtr->hasDL() ? srcDLCoordInternal.size() / 3 : 0;
+    fmmPtr->setupTree(nSL, srcSLCoordInternal.data(), nDL, srcDLCoordInternal.data(), nTrgInternal, trgCoordData());
 }
 
 void Stk3DFMM::evaluateFMM(const KERNEL kernel, const int nSL, const double *srcSLValuePtr, const int nTrg,
-                           double *trgValuePtr, const int nDL, const double *srcDLValuePtr) {
+                           double *trgValuePtr, const int nDL, const double *srcDLValuePtr, const EVALMODE mode) {
 
     using namespace impl;
     if (poolFMM.find(kernel) == poolFMM.end()) {
@@ -87,27 +164,130 @@ void Stk3DFMM::evaluateFMM(const KERNEL kernel, const int nSL, const double *src
     }
     FMMData &fmm = *((*poolFMM.find(kernel)).second);
 
-    srcSLValueInternal.resize(nSL * fmm.kdimSL);
-    trgValueInternal.resize(nTrg * fmm.kdimTrg);
-    std::copy(srcSLValuePtr, srcSLValuePtr + nSL * fmm.kdimSL, srcSLValueInternal.begin());
+    // run FMM with proper scaling, directly on user buffers
+    fmm.evaluateFMM(nSL, srcSLValuePtr, nDL, srcDLValuePtr, nTrg, trgValuePtr, scaleFactor, mode);
+
+    return;
+}
 
-    // run FMM with proper scaling
-    if (fmm.hasDL()) {
-        srcDLValueInternal.resize(nDL * fmm.kdimDL);
-        std::copy(srcDLValuePtr, srcDLValuePtr + nDL * fmm.kdimDL, srcDLValueInternal.begin());
-        fmm.evaluateFMM(srcSLValueInternal, srcDLValueInternal, trgValueInternal, scaleFactor);
-    } else {
-        std::vector<double> empty(0);
-        fmm.evaluateFMM(srcSLValueInternal, empty, trgValueInternal, scaleFactor);
+void Stk3DFMM::evaluateFMMBatch(const KERNEL kernel, const int nRHS, const int nSL, const double *srcSLValuePtr,
+                                const int nTrg, double *trgValuePtr, const int nDL, const double *srcDLValuePtr,
+                                const EVALMODE mode) {
+    using namespace impl;
+    if (poolFMM.find(kernel) == poolFMM.end()) {
+        std::cout << "Error: no such FMMData exists for kernel " << getKernelName(kernel) << std::endl;
+        exit(1);
+    }
+    const int kdimSL = poolFMM[kernel]->kdimSL;
+    const int kdimDL = poolFMM[kernel]->kdimDL;
+    const int kdimTrg = poolFMM[kernel]->kdimTrg;
+    // the set r starts at offset r * kdim of each array
+    auto evaluate = [&](FMMData &fmm, const int r) {
+        fmm.evaluateFMM(nSL, srcSLValuePtr + r * kdimSL, nDL, srcDLValuePtr ? srcDLValuePtr + r * kdimDL : nullptr,
+                        nTrg, trgValuePtr + r * kdimTrg, scaleFactor, mode, nRHS);
+    };
+
+    // full batches with the batched kernel, created at the first call.
+    // collective, all ranks pass the same kernel and nRHS
+    auto batch = batchKernelMap.find(kernel);
+    const int nBatched = (batch == batchKernelMap.end()) ? 0 : nRHS / nBatchRHS * nBatchRHS;
+    if (nBatched > 0) {
+        if (poolFMM.find(batch->second) == poolFMM.end()) {
+            auto fmm = new FMMData(batch->second, pbc, multOrder, maxPts, enableFF, precision);
+            fmm->costWeighted = poolFMM[kernel]->costWeighted;
+            poolFMM[batch->second] = fmm;
+        }
+        setupTree(batch->second);
+        for (int r = 0; r < nBatched; r += nBatchRHS)
+            evaluate(*poolFMM[batch->second], r);
     }
 
-    const int nloop = nTrg * fmm.kdimTrg;
+    // the rest one set at a time
+    if (nBatched < nRHS)
+        setupTree(kernel);
+    for (int r = nBatched; r < nRHS; r++)
+        evaluate(*poolFMM[kernel], r);
+}
+
+void Stk3DFMM::evaluateFused(const std::vector<KERNEL> &kernels, const int nSL,
+                             const std::vector<const double *> &srcSLValuePtrs, const int nTrg,
+                             const std::vector<double *> &trgValuePtrs, const int nDL,
+                             const std::vector<const double *> &srcDLValuePtrs, const EVALMODE mode,
+                             std::vector<bool> &done) {
+    using namespace impl;
+    // position in kernels, kernels.size() if not requested or not activated
+    auto find = [&](const KERNEL kernel) -> size_t {
+        if (poolFMM.find(kernel) == poolFMM.end())
+            return kernels.size();
+        return std::find(kernels.begin(), kernels.end(), kernel) - kernels.begin();
+    };
+
+    // set up the fused kernel, created at the first call. collective, all ranks pass the same kernels
+    auto setupFused = [&](const KERNEL fused, const KERNEL first) {
+        if (poolFMM.find(fused) == poolFMM.end()) {
+            auto fmm = new FMMData(fused, pbc, multOrder, maxPts, enableFF, precision);
+            fmm->costWeighted = poolFMM[first]->costWeighted;
+            poolFMM[fused] = fmm;
+        }
+        setupTree(fused);
+    };
+
+    // components [offset, offset + kdim) of the kdimFused fused target values
+    auto unpack = [&](const int kdimFused, double *trgValuePtr, const int kdim, const int offset) {
+        const bool overwrite = (mode == EVALMODE::OVERWRITE);
+#pragma omp parallel for
+        for (int i = 0; i < nTrg; i++) {
+            const double *trg = trgValueInternal.data() + kdimFused * i + offset;
+            for (int j = 0; j < kdim; j++)
+                trgValuePtr[kdim * i + j] = overwrite ? trg[j] : trgValuePtr[kdim * i + j] + trg[j];
+        }
+    };
+
+    // fx,fy,fz,q -> ux,uy,uz,p,grad p, the DL sources are the Laplace dipoles
+    const size_t stk = find(KERNEL::Stokes);
+    const size_t lap = find(KERNEL::LapPGrad);
+    if (stk < kernels.size() && lap < kernels.size()) {
+        setupFused(KERNEL::StokesLapPGrad, KERNEL::Stokes);
+        const double *f = srcSLValuePtrs[stk];
+        const double *q = srcSLValuePtrs[lap];
+        srcSLValueInternal.resize(4 * nSL);
 #pragma omp parallel for
-    for (int i = 0; i < nloop; i++) {
-        trgValuePtr[i] += trgValueInternal[i];
+        for (int i = 0; i < nSL; i++) {
+            srcSLValueInternal[4 * i + 0] = f[3 * i + 0];
+            srcSLValueInternal[4 * i + 1] = f[3 * i + 1];
+            srcSLValueInternal[4 * i + 2] = f[3 * i + 2];
+            srcSLValueInternal[4 * i + 3] = q[i];
+        }
+        const double *d = srcDLValuePtrs[lap];
+        if (d == nullptr) {
+            srcDLValueInternal.assign(3 * nDL, 0.0);
+            d = srcDLValueInternal.data();
+        }
+        trgValueInternal.resize(7 * nTrg);
+        evaluateFMM(KERNEL::StokesLapPGrad, nSL, srcSLValueInternal.data(), nTrg, trgValueInternal.data(), nDL, d,
+                    EVALMODE::OVERWRITE);
+        unpack(7, trgValuePtrs[stk], 3, 0);
+        unpack(7, trgValuePtrs[lap], 4, 3);
+        done[stk] = true;
+        done[lap] = true;
     }
 
-    return;
+    // p,vel and traction of the same sources, passed as the same arrays on all ranks
+    const size_t pvel = find(KERNEL::PVel);
+    const size_t traction = find(KERNEL::Traction);
+    int sameSrc = pvel < kernels.size() && traction < kernels.size() &&
+                  srcSLValuePtrs[pvel] == srcSLValuePtrs[traction] && srcDLValuePtrs[pvel] == srcDLValuePtrs[traction];
+    MPI_Allreduce(MPI_IN_PLACE, &sameSrc, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (sameSrc) {
+        setupFused(KERNEL::PVelTraction, KERNEL::PVel);
+        trgValueInternal.resize(13 * nTrg);
+        evaluateFMM(KERNEL::PVelTraction, nSL, srcSLValuePtrs[pvel], nTrg, trgValueInternal.data(), nDL,
+                    srcDLValuePtrs[pvel], EVALMODE::OVERWRITE);
+        unpack(13, trgValuePtrs[pvel], 4, 0);
+        unpack(13, trgValuePtrs[traction], 9, 4);
+        done[pvel] = true;
+        done[traction] = true;
+    }
 }
 
 void Stk3DFMM::clearFMM(KERNEL kernel) {
@@ -121,4 +301,76 @@ void Stk3DFMM::clearFMM(KERNEL kernel) {
     }
 }
 
+double Stk3DFMM::checkError(const KERNEL kernel, const int nSample, const int nSL, const double *srcSLCoordPtr,
+                            const double *srcSLValuePtr, const int nTrg, const double *trgCoordPtr,
+                            const double *trgValuePtr, const int nDL, const double *srcDLCoordPtr,
+                            const double *srcDLValuePtr) {
+    using namespace impl;
+    if (poolFMM.find(kernel) == poolFMM.end()) {
+        std::cout << "Error: no such FMMData exists for kernel " << getKernelName(kernel) << std::endl;
+        exit(1);
+    }
+    if (pbc != PAXIS::NONE) {
+        if (!rank)
+            std::cout << "checkError works for free space only" << std::endl;
+        return -1;
+    }
+    FMMData &fmm = *((*poolFMM.find(kernel)).second);
+    const int kdimSL = fmm.kdimSL;
+    const int kdimDL = fmm.kdimDL;
+    const int kdimTrg = fmm.kdimTrg;
+
+    // all sources on every rank
+    int nProcs;
+    MPI_Comm_size(MPI_COMM_WORLD, &nProcs);
+    auto gather = [&](const int n, const double *ptr, const int dim) {
+        std::vector<int> counts(nProcs), displs(nProcs, 0);
+        int count = n * dim;
+        MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+        for (int i = 1; i < nProcs; i++)
+            displs[i] = displs[i - 1] + counts[i - 1];
+        std::vector<double> all(displs.back() + counts.back());
+        MPI_Allgatherv(ptr, count, MPI_DOUBLE, all.data(), counts.data(), displs.data(), MPI_DOUBLE,
+                       MPI_COMM_WORLD);
+        return all;
+    };
+    std::vector<double> srcSLCoord = gather(nSL, srcSLCoordPtr, 3);
+    std::vector<double> srcSLValue = gather(nSL, srcSLValuePtr, kdimSL);
+    const bool checkDL = fmm.hasDL();
+    std::vector<double> srcDLCoord = gather(checkDL ? nDL : 0, srcDLCoordPtr, 3);
+    std::vector<double> srcDLValue = gather(checkDL ? nDL : 0, srcDLValuePtr, kdimDL);
+
+    // random sample of local targets, without repetition
+    std::vector<int> index(nTrg);
+    std::iota(index.begin(), index.end(), 0);
+    std::mt19937 gen(rank);
+    std::shuffle(index.begin(), index.end(), gen);
+    const int nCheck = std::max(std::min(nSample, nTrg), 0);
+    std::vector<double> sampleCoord(3 * nCheck);
+    std::vector<double> sampleDirect(kdimTrg * nCheck, 0.0);
+    for (int i = 0; i < nCheck; i++) {
+        std::copy_n(trgCoordPtr + 3 * index[i], 3, sampleCoord.data() + 3 * i);
+    }
+
+    fmm.evaluateKernel(0, PPKERNEL::SLS2T, srcSLCoord.size() / 3, srcSLCoord.data(), srcSLValue.data(), nCheck,
+                       sampleCoord.data(), sampleDirect.data());
+    if (checkDL && !srcDLCoord.empty()) {
+        fmm.evaluateKernel(0, PPKERNEL::DLS2T, srcDLCoord.size() / 3, srcDLCoord.data(), srcDLValue.data(), nCheck,
+                           sampleCoord.data(), sampleDirect.data());
+    }
+
+    double errorSq[2] = {0, 0}; // error, reference
+    for (int i = 0; i < nCheck; i++) {
+        for (int j = 0; j < kdimTrg; j++) {
+            const double direct = sampleDirect[kdimTrg * i + j];
+            const double error = trgValuePtr[kdimTrg * index[i] + j] - direct;
+            errorSq[0] += error * error;
+            errorSq[1] += direct * direct;
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, errorSq, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    return errorSq[1] > 0 ? std::sqrt(errorSq[0] / errorSq[1]) : std::sqrt(errorSq[0]);
+}
+
 } // namespace stkfmm
@@ -2,36 +2,65 @@
 
 namespace stkfmm {
 
-StkWallFMM::StkWallFMM(int multOrder_, int maxPts_, PAXIS pbc_, unsigned int kernelComb_, bool enableFF_)
-    : STKFMM(multOrder_, maxPts_, pbc_, kernelComb_) {
-    using namespace impl;
+StkWallFMM::StkWallFMM(int multOrder_, int maxPts_, PAXIS pbc_, unsigned int kernelComb_, bool enableFF_,
+                       PRECISION precision_)
+    : STKFMM(multOrder_, maxPts_, pbc_, kernelComb_, enableFF_, precision_) {
     poolFMM.clear();
+    StkWallFMM::enableKernels(kernelComb);
+
+    if (poolFMM.empty()) {
+        std::cout << "Error: no kernel activated\n";
+    }
+}
+
+void StkWallFMM::enableKernels(unsigned int kernelComb_) {
+    using namespace impl;
+    // pvfmm operators are initialized at the first setupTree()
+    auto enable = [&](KERNEL kernel) {
+        if (poolFMM.find(kernel) == poolFMM.end())
+            poolFMM[kernel] = new FMMData(kernel, pbc, multOrder, maxPts, enableFF, precision);
+    };
 
-    if (kernelComb & asInteger(KERNEL::Stokes)) {
+    if ((kernelComb_ & asInteger(KERNEL::Stokes)) && poolFMM.find(KERNEL::Stokes) == poolFMM.end()) {
         // Stokes image, activate Stokes & Laplace kernels
-        poolFMM[KERNEL::Stokes] = new FMMData(KERNEL::Stokes, pbc, multOrder, maxPts, enableFF_);             // uS
-        poolFMM[KERNEL::LapPGrad] = new FMMData(KERNEL::LapPGrad, pbc, multOrder, maxPts, enableFF_);         // uL1+uD
-        poolFMM[KERNEL::LapPGradGrad] = new FMMData(KERNEL::LapPGradGrad, pbc, multOrder, maxPts, enableFF_); // uL2
+        enable(KERNEL::Stokes);       // uS
+        enable(KERNEL::LapPGrad);     // uL1+uD
+        enable(KERNEL::LapPGradGrad); // uL2
         if (!rank)
             std::cout << "enable Stokes image kernel " << std::endl;
     }
 
-    if (kernelComb & asInteger(KERNEL::RPY)) {
-        // RPY image, activate RPY, Laplace, & LapQuad kernels
-        poolFMM[KERNEL::RPY] = new FMMData(KERNEL::RPY, pbc, multOrder, maxPts, enableFF_);           // uS
-        poolFMM[KERNEL::LapPGrad] = new FMMData(KERNEL::LapPGrad, pbc, multOrder, maxPts, enableFF_); // phiSZ+phiDZ
-        poolFMM[KERNEL::LapPGradGrad] =
-            new FMMData(KERNEL::LapPGradGrad, pbc, multOrder, maxPts, enableFF_); // phiS+phiD
-        poolFMM[KERNEL::LapQPGradGrad] = new FMMData(KERNEL::LapQPGradGrad, pbc, multOrder, maxPts, enableFF_); // phibQ
-        std::cout << "enable RPY image kernel " << std::endl;
+    if ((kernelComb_ & asInteger(KERNEL::RPY)) && poolFMM.find(KERNEL::RPY) == poolFMM.end()) {
+        // RPY image, one fused kernel for uS, phiS+phiD+phibQ, and phiSZ+phiDZ
+        poolFMM[KERNEL::RPY] = new FMMData(KERNEL::RPYWall, pbc, multOrder, maxPts, enableFF, precision);
+        if (!rank)
+            std::cout << "enable RPY image kernel " << std::endl;
     }
+    kernelComb |= kernelComb_;
+    setupWorkspace();
+}
 
-    if (poolFMM.empty()) {
-        std::cout << "Error: no kernel activated\n";
+void StkWallFMM::setupWorkspace() {
+    const int nSL = srcSLCoordInternal.size() / 6;
+    const int nTrg = nTrgInternal;
+    // zero once, every evaluation writes the same entries and the others stay zero
+    if (poolFMM.find(KERNEL::Stokes) != poolFMM.end()) {
+        srcValStk.assign(nSL * 3 * 2, 0);
+        trgValStk.assign(nTrg * 3, 0);
+        srcValL1.assign(nSL * 2, 0);
+        srcValD.assign(nSL * 3, 0);
+        trgValL1D.assign(nTrg * 4, 0);
+        srcValL2.assign(nSL * 2, 0);
+        trgValL2.assign(nTrg * 10, 0);
+    }
+    if (poolFMM.find(KERNEL::RPY) != poolFMM.end()) {
+        srcValRPY.assign(nSL * 21 * 2, 0);
+        trgValRPY.assign(nTrg * 20, 0);
     }
 }
 
 StkWallFMM::~StkWallFMM() {
+    stopAsync();
     // delete all FMMData
     for (auto &fmm : poolFMM) {
         safeDeletePtr(fmm.second);
@@ -40,6 +69,7 @@ StkWallFMM::~StkWallFMM() {
 
 void StkWallFMM::setPoints(const int nSL, const double *srcSLCoordPtr, const int nTrg, const double *trgCoordPtr,
                            const int nDL, const double *srcDLCoordPtr) {
+    const double startTime = MPI_Wtime();
     if (!poolFMM.empty()) {
         for (auto &fmm : poolFMM) {
             // if (rank == 0)
@@ -62,10 +92,17 @@ void StkWallFMM::setPoints(const int nSL, const double *srcSLCoordPtr, const int
         }
     };
 
-    // trg origin -> trgInternal
-    setCoord(nTrg, trgCoordPtr, trgCoordInternal);
+    // trg origin -> trgInternal, or the SL origins if targets are the SL sources
+    trgIsSrcSL = sharedPoints(nSL, srcSLCoordPtr, nTrg, trgCoordPtr);
+    nTrgInternal = nTrg;
+    if (trgIsSrcSL) {
+        trgCoordInternal.clear();
+        trgCoordInternal.shrink_to_fit();
+    } else {
+        setCoord(nTrg, trgCoordPtr, trgCoordInternal);
+    }
 
-    // src origin+image -> srcSLInternal
+    // src origin+image -> srcSLInternal, nSL origins followed by nSL images
     srcSLCoordInternal.reserve(6 * nSL);
     setCoord(nSL, srcSLCoordPtr, srcSLCoordInternal);
     srcSLCoordInternal.resize(6 * nSL);
@@ -76,28 +113,44 @@ void StkWallFMM::setPoints(const int nSL, const double *srcSLCoordPtr, const int
         srcSLCoordInternal[3 * (i + nSL) + 2] = 1 - srcSLCoordInternal[3 * i + 2];
     }
 
-    // src origin/image
-    srcSLImageCoordInternal.resize(3 * nSL);
-    std::copy(srcSLCoordInternal.begin() + 3 * nSL, srcSLCoordInternal.begin() + 6 * nSL,
-              srcSLImageCoordInternal.begin());
-    srcSLOriginCoordInternal.resize(3 * nSL);
-    std::copy(srcSLCoordInternal.begin(), srcSLCoordInternal.begin() + 3 * nSL, srcSLOriginCoordInternal.begin());
+    setupWorkspace();
+
+    // shared by all kernels
+    const double ingestTime = MPI_Wtime() - startTime;
+    for (auto &fmm : poolFMM)
+        fmm.second->perf.seconds[asInteger(PHASE::INGEST)] += ingestTime;
 
     if (verbose && rank == 0)
         std::cout << "points set\n";
 }
 
 void StkWallFMM::setupTree(KERNEL kernel) {
+    // all image terms live on the origin and image points, see evalStokes() and evalRPY()
+    const int nSL = srcSLCoordInternal.size() / 3;
+    const double *srcSLCoord = srcSLCoordInternal.data();
+    const double *trgCoord = trgCoordData();
     if (kernel == KERNEL::Stokes) {
-        poolFMM[KERNEL::Stokes]->setupTree(srcSLCoordInternal, std::vector<double>(), trgCoordInternal);
-        poolFMM[KERNEL::LapPGrad]->setupTree(srcSLCoordInternal, srcSLImageCoordInternal, trgCoordInternal);
-        poolFMM[KERNEL::LapPGradGrad]->setupTree(srcSLCoordInternal, std::vector<double>(), trgCoordInternal);
+        if (poolFMM[KERNEL::Stokes]->hasTree())
+            return;
+        impl::FMMData *stk = poolFMM[KERNEL::Stokes];
+        impl::FMMData *lapPGrad = poolFMM[KERNEL::LapPGrad];
+        impl::FMMData *lapPGradGrad = poolFMM[KERNEL::LapPGradGrad];
+        // initialization may tune maxPts with all threads, so not concurrently
+        stk->initialize();
+        lapPGrad->initialize();
+        lapPGradGrad->initialize();
+        runConcurrently({
+            [&]() { stk->setupTree(nSL, srcSLCoord, 0, nullptr, nTrgInternal, trgCoord); },
+            [&]() {
+                // DL on the images only
+                lapPGrad->setupTree(nSL, srcSLCoord, nSL / 2, srcSLCoord + 3 * (nSL / 2), nTrgInternal, trgCoord);
+            },
+            [&]() { lapPGradGrad->setupTree(nSL, srcSLCoord, 0, nullptr, nTrgInternal, trgCoord); },
+        });
     } else if (kernel == KERNEL::RPY) {
-        poolFMM[KERNEL::RPY]->setupTree(srcSLCoordInternal, std::vector<double>(), trgCoordInternal);
-        poolFMM[KERNEL::LapPGrad]->setupTree(srcSLCoordInternal, srcSLCoordInternal, trgCoordInternal);
-        poolFMM[KERNEL::LapPGradGrad]->setupTree(srcSLCoordInternal, srcSLImageCoordInternal, trgCoordInternal);
-        poolFMM[KERNEL::LapQPGradGrad]->setupTree(srcSLImageCoordInternal, std::vector<double>(), trgCoordInternal,
-                                                  srcSLCoordInternal.size() / 3, srcSLCoordInternal.data());
+        if (poolFMM[KERNEL::RPY]->hasTree())
+            return;
+        poolFMM[KERNEL::RPY]->setupTree(nSL, srcSLCoord, 0, nullptr, nTrgInternal, trgCoord);
     } else {
         std::cout << "Kernel not supported\n";
         std::exit(1);
@@ -105,34 +158,46 @@ void StkWallFMM::setupTree(KERNEL kernel) {
 }
 
 void StkWallFMM::evaluateFMM(const KERNEL kernel, const int nSL, const double *srcSLValuePtr, const int nTrg,
-                             double *trgValuePtr, const int nDL, const double *srcDLValuePtr) {
+                             double *trgValuePtr, const int nDL, const double *srcDLValuePtr, const EVALMODE mode) {
 
+    int kdimTrg = 0;
     if (kernel == KERNEL::Stokes) {
         // 3->3
+        kdimTrg = 3;
         srcSLValueInternal.resize(nSL * 3);
         trgValueInternal.resize(nTrg * 3);
         std::copy(srcSLValuePtr, srcSLValuePtr + 3 * nSL, srcSLValueInternal.begin());
         evalStokes();
-        const int nloop = 3 * nTrg;
-#pragma omp parallel for
-        for (int i = 0; i < nloop; i++) {
-            trgValuePtr[i] += trgValueInternal[i];
-        }
     } else if (kernel == KERNEL::RPY) {
         // 4->6
+        kdimTrg = 6;
         srcSLValueInternal.resize(nSL * 4);
         trgValueInternal.resize(nTrg * 6);
         std::copy(srcSLValuePtr, srcSLValuePtr + 4 * nSL, srcSLValueInternal.begin());
         evalRPY();
-        const int nloop = 6 * nTrg;
+    } else {
+        std::cout << "Kernel not supported\n";
+        std::exit(1);
+    }
+
+    double time = MPI_Wtime();
+    const int nloop = kdimTrg * nTrg;
+    if (mode == EVALMODE::OVERWRITE) {
+        std::copy(trgValueInternal.begin(), trgValueInternal.begin() + nloop, trgValuePtr);
+    } else {
 #pragma omp parallel for
         for (int i = 0; i < nloop; i++) {
             trgValuePtr[i] += trgValueInternal[i];
         }
-    } else {
-        std::cout << "Kernel not supported\n";
-        std::exit(1);
     }
+    poolFMM[kernel]->tick(PHASE::COPYOUT, time);
+}
+
+std::size_t StkWallFMM::internalBytes() const {
+    const std::size_t workspace = srcValStk.capacity() + trgValStk.capacity() + srcValL1.capacity() +
+                                  srcValD.capacity() + trgValL1D.capacity() + srcValL2.capacity() +
+                                  trgValL2.capacity() + srcValRPY.capacity() + trgValRPY.capacity();
+    return STKFMM::internalBytes() + workspace * sizeof(double);
 }
 
 void StkWallFMM::clearFMM(KERNEL kernel) {
@@ -142,9 +207,6 @@ void StkWallFMM::clearFMM(KERNEL kernel) {
         poolFMM[KERNEL::LapPGradGrad]->clear();
     } else if (kernel == KERNEL::RPY) {
         poolFMM[KERNEL::RPY]->clear();
-        poolFMM[KERNEL::LapPGrad]->clear();
-        poolFMM[KERNEL::LapPGradGrad]->clear();
-        poolFMM[KERNEL::LapQPGradGrad]->clear();
     } else {
         std::cout << "Kernel not supported\n";
         std::exit(1);
@@ -152,53 +214,62 @@ void StkWallFMM::clearFMM(KERNEL kernel) {
 }
 
 void StkWallFMM::evalStokes() {
-    const int nSL = srcSLOriginCoordInternal.size() / 3;
-    const int nTrg = trgCoordInternal.size() / 3;
-    std::vector<double> srcValStk(nSL * 3 * 2, 0), trgValStk(nTrg * 3, 0);                 // StokesFMM, 3->3
-    std::vector<double> srcValL1(nSL * 2, 0), srcValD(nSL * 3, 0), trgValL1D(nTrg * 4, 0); // LapPGrad, 1/3->4
-    std::vector<double> srcValL2(nSL * 2, 0), trgValL2(nTrg * 10, 0);                      // LapPGradGrad, 1->10
-    std::vector<double> empty;
+    const int nSL = srcSLCoordInternal.size() / 6;
+    const int nTrg = nTrgInternal;
+    const double *trgCoord = trgCoordData();
+    std::vector<double> emptyStk, emptyL2;
     const double sF = scaleFactor;
+    impl::FMMData *stk = poolFMM[KERNEL::Stokes];
+    impl::FMMData *lapPGrad = poolFMM[KERNEL::LapPGrad];
+    impl::FMMData *lapPGradGrad = poolFMM[KERNEL::LapPGradGrad];
+
     // step1 Stokes FMM
+    auto stokes = [&]() {
 #pragma omp parallel for
-    for (int i = 0; i < nSL; i++) {
-        srcValStk[3 * i] = srcSLValueInternal[3 * i];
-        srcValStk[3 * i + 1] = srcSLValueInternal[3 * i + 1];
-        srcValStk[3 * (i + nSL)] = -srcSLValueInternal[3 * i];
-        srcValStk[3 * (i + nSL) + 1] = -srcSLValueInternal[3 * i + 1];
-    }
-    empty.clear();
-    poolFMM[KERNEL::Stokes]->evaluateFMM(srcValStk, empty, trgValStk, scaleFactor);
+        for (int i = 0; i < nSL; i++) {
+            srcValStk[3 * i] = srcSLValueInternal[3 * i];
+            srcValStk[3 * i + 1] = srcSLValueInternal[3 * i + 1];
+            srcValStk[3 * (i + nSL)] = -srcSLValueInternal[3 * i];
+            srcValStk[3 * (i + nSL) + 1] = -srcSLValueInternal[3 * i + 1];
+        }
+        stk->evaluateFMM(srcValStk, emptyStk, trgValStk, scaleFactor);
+    };
 
     // step2 LapPGrad L1D
+    auto lapL1D = [&]() {
 #pragma omp parallel for
-    for (int i = 0; i < nSL; i++) {
-        srcValL1[i] = -0.5 * srcSLValueInternal[3 * i + 2];
-        srcValL1[i + nSL] = 0.5 * srcSLValueInternal[3 * i + 2];
-    }
+        for (int i = 0; i < nSL; i++) {
+            srcValL1[i] = -0.5 * srcSLValueInternal[3 * i + 2];
+            srcValL1[i + nSL] = 0.5 * srcSLValueInternal[3 * i + 2];
+        }
 #pragma omp parallel for
-    for (int i = 0; i < nSL; i++) {
-        const double y3 = (srcSLOriginCoordInternal[3 * i + 2] - 0.5) / sF;
-        srcValD[3 * i + 0] = -y3 * srcSLValueInternal[3 * i + 0];
-        srcValD[3 * i + 1] = -y3 * srcSLValueInternal[3 * i + 1];
-        srcValD[3 * i + 2] = y3 * srcSLValueInternal[3 * i + 2];
-    }
-    poolFMM[KERNEL::LapPGrad]->evaluateFMM(srcValL1, srcValD, trgValL1D, scaleFactor);
+        for (int i = 0; i < nSL; i++) {
+            const double y3 = (srcSLCoordInternal[3 * i + 2] - 0.5) / sF;
+            srcValD[3 * i + 0] = -y3 * srcSLValueInternal[3 * i + 0];
+            srcValD[3 * i + 1] = -y3 * srcSLValueInternal[3 * i + 1];
+            srcValD[3 * i + 2] = y3 * srcSLValueInternal[3 * i + 2];
+        }
+        lapPGrad->evaluateFMM(srcValL1, srcValD, trgValL1D, scaleFactor);
+    };
 
     // step3 LapPGradGrad L2
+    auto lapL2 = [&]() {
 #pragma omp parallel for
-    for (int i = 0; i < nSL; i++) {
-        const double y3 = (srcSLOriginCoordInternal[3 * i + 2] - 0.5) / sF;
-        srcValL2[i] = srcSLValueInternal[3 * i + 2] * y3;
-        srcValL2[i + nSL] = -srcValL2[i];
-    }
-    empty.clear();
-    poolFMM[KERNEL::LapPGradGrad]->evaluateFMM(srcValL2, empty, trgValL2, scaleFactor);
+        for (int i = 0; i < nSL; i++) {
+            const double y3 = (srcSLCoordInternal[3 * i + 2] - 0.5) / sF;
+            srcValL2[i] = srcSLValueInternal[3 * i + 2] * y3;
+            srcValL2[i + nSL] = -srcValL2[i];
+        }
+        lapPGradGrad->evaluateFMM(srcValL2, emptyL2, trgValL2, scaleFactor);
+    };
+
+    // the three FMMs are independent
+    runConcurrently({stokes, lapL1D, lapL2});
 
     // step 4 Assemble together
 #pragma omp parallel for
     for (int i = 0; i < nTrg; i++) {
-        const double x3 = (trgCoordInternal[3 * i + 2] - 0.5) / sF;
+        const double x3 = (trgCoord[3 * i + 2] - 0.5) / sF;
         for (int j = 0; j < 3; j++) {
             trgValueInternal[3 * i + j] =
                 trgValStk[3 * i + j] + 0.5 * trgValL2[10 * i + j + 1] + x3 * trgValL1D[4 * i + j + 1];
@@ -208,86 +279,67 @@ void StkWallFMM::evalStokes() {
 }
 
 void StkWallFMM::evalRPY() {
-    const int nSL = srcSLOriginCoordInternal.size() / 3;
-    const int nTrg = trgCoordInternal.size() / 3;
-    std::vector<double> srcValRPY(nSL * 4 * 2, 0), trgValRPY(nTrg * 6, 0);                    // RPYFMM, 4->6
-    std::vector<double> srcValLS(nSL * 2, 0), srcValLD(nSL * 3, 0), trgValSD(nTrg * 10, 0);   // LapPGradGrad S, 1/3->10
-    std::vector<double> srcValLSZ(nSL * 2, 0), srcValLDZ(nSL * 6, 0), trgValSDZ(nTrg * 4, 0); // LapPGrad, 1/3->4
-    std::vector<double> srcValQ(nSL * 9, 0), trgValQ(nTrg * 10, 0);                           // LapQPGradGrad, 9->10
+    const int nSL = srcSLCoordInternal.size() / 6;
+    const int nTrg = nTrgInternal;
+    const double *trgCoord = trgCoordData();
+    // RPYWall, 21->20, see RPYWallKernel.hpp for the layout
     std::vector<double> empty;
     const double sF = scaleFactor;
 
-// step1 RPYFMM
-#pragma omp parallel for
-    for (int i = 0; i < nSL; i++) {
-        srcValRPY[4 * i] = srcSLValueInternal[4 * i];         // fx
-        srcValRPY[4 * i + 1] = srcSLValueInternal[4 * i + 1]; // fy
-        srcValRPY[4 * i + 3] = srcSLValueInternal[4 * i + 3]; // b
-        srcValRPY[4 * (i + nSL)] = -srcSLValueInternal[4 * i];
-        srcValRPY[4 * (i + nSL) + 1] = -srcSLValueInternal[4 * i + 1];
-        srcValRPY[4 * (i + nSL) + 3] = srcSLValueInternal[4 * i + 3]; // b
-    }
-    empty.clear();
-    poolFMM[KERNEL::RPY]->evaluateFMM(srcValRPY, empty, trgValRPY, sF);
-
-// step2 Laplace SD
-#pragma omp parallel for
-    for (int i = 0; i < nSL; i++) {
-        srcValLS[i] = srcSLValueInternal[4 * i + 2] * (-0.5);
-        srcValLS[i + nSL] = -srcSLValueInternal[4 * i + 2] * (-0.5);
-        const double y3 = (srcSLOriginCoordInternal[3 * i + 2] - 0.5) / sF;
-        srcValLD[3 * i] = -y3 * srcSLValueInternal[4 * i];
-        srcValLD[3 * i + 1] = -y3 * srcSLValueInternal[4 * i + 1];
-        srcValLD[3 * i + 2] = y3 * srcSLValueInternal[4 * i + 2];
-    }
-    poolFMM[KERNEL::LapPGradGrad]->evaluateFMM(srcValLS, srcValLD, trgValSD, sF);
-
-// step3 Laplace SDZ
-#pragma omp parallel for
-    for (int i = 0; i < nSL; i++) {
-        const double y3 = (srcSLOriginCoordInternal[3 * i + 2] - 0.5) / sF;
-        const double b = srcSLValueInternal[4 * i + 3];
-        const double b2 = b * b;
-        const double f3 = srcSLValueInternal[4 * i + 2];
-        srcValLSZ[i] = y3 * f3 * 0.5;
-        srcValLSZ[i + nSL] = -y3 * f3 * 0.5;
-        srcValLDZ[3 * i + 2] = b2 * f3 * (1. / 6.);
-        srcValLDZ[3 * (i + nSL) + 2] = b2 * f3 * (1. / 6.);
-    }
-    poolFMM[KERNEL::LapPGrad]->evaluateFMM(srcValLSZ, srcValLDZ, trgValSDZ, sF);
-
-// step4 Laplace QPGradGrad
+// step1 pack RPY, Laplace S, D, Q on images, Laplace SZ, DZ
 #pragma omp parallel for
     for (int i = 0; i < nSL; i++) {
         const double f1 = srcSLValueInternal[4 * i];
         const double f2 = srcSLValueInternal[4 * i + 1];
         const double f3 = srcSLValueInternal[4 * i + 2];
         const double b = srcSLValueInternal[4 * i + 3];
-        const double twob2 = 2 * b * b;
-        srcValQ[9 * i] = twob2 * f3 * (1. / 6.);
-        srcValQ[9 * i + 4] = twob2 * f3 * (1. / 6.);
-        srcValQ[9 * i + 6] = twob2 * f1 * (1. / 6.);
-        srcValQ[9 * i + 7] = twob2 * f2 * (1. / 6.);
+        const double b2 = b * b;
+        const double y3 = (srcSLCoordInternal[3 * i + 2] - 0.5) / sF;
+        double *orig = srcValRPY.data() + 21 * i;
+        double *image = srcValRPY.data() + 21 * (i + nSL);
+
+        // RPY
+        orig[0] = f1;
+        orig[1] = f2;
+        orig[3] = b;
+        image[0] = -f1;
+        image[1] = -f2;
+        image[3] = b;
+        // Laplace S + D + Q
+        orig[4] = -0.5 * f3;
+        image[4] = 0.5 * f3;
+        image[5] = -y3 * f1;
+        image[6] = -y3 * f2;
+        image[7] = y3 * f3;
+        image[8] = 2 * b2 * f3 * (1. / 6.);
+        image[12] = 2 * b2 * f3 * (1. / 6.);
+        image[14] = 2 * b2 * f1 * (1. / 6.);
+        image[15] = 2 * b2 * f2 * (1. / 6.);
+        // Laplace SZ + DZ
+        orig[17] = 0.5 * y3 * f3;
+        image[17] = -0.5 * y3 * f3;
+        orig[20] = b2 * f3 * (1. / 6.);
+        image[20] = b2 * f3 * (1. / 6.);
     }
-    empty.clear();
-    poolFMM[KERNEL::LapQPGradGrad]->evaluateFMM(srcValQ, empty, trgValQ, sF);
+
+    // step2 one FMM for all image terms
+    poolFMM[KERNEL::RPY]->evaluateFMM(srcValRPY, empty, trgValRPY, sF);
 
 // assemble
 #pragma omp parallel for
     for (int i = 0; i < nTrg; i++) {
         // 6 dimensional array per target [vx,vy,vz,gx,gy,gz]
         // u = [vx,vy,vz]+a^2/6*[gx,gy,gz]
-        const double x3 = (trgCoordInternal[3 * i + 2] - 0.5) / sF;
-        trgValueInternal[6 * i + 0] = //
-            trgValRPY[6 * i + 0] + trgValSDZ[4 * i + 1] + x3 * trgValSD[10 * i + 1] + x3 * trgValQ[10 * i + 1];
-        trgValueInternal[6 * i + 1] = //
-            trgValRPY[6 * i + 1] + trgValSDZ[4 * i + 2] + x3 * trgValSD[10 * i + 2] + x3 * trgValQ[10 * i + 2];
-        trgValueInternal[6 * i + 2] =                                                                          //
-            trgValRPY[6 * i + 2] + trgValSDZ[4 * i + 3] + x3 * trgValSD[10 * i + 3] + x3 * trgValQ[10 * i + 3] //
-            - trgValSD[10 * i] - trgValQ[10 * i];
-        trgValueInternal[6 * i + 3] = trgValRPY[6 * i + 3] + 2 * trgValSD[10 * i + 6] + 2 * trgValQ[10 * i + 6];
-        trgValueInternal[6 * i + 4] = trgValRPY[6 * i + 4] + 2 * trgValSD[10 * i + 8] + 2 * trgValQ[10 * i + 8];
-        trgValueInternal[6 * i + 5] = trgValRPY[6 * i + 5] + 2 * trgValSD[10 * i + 9] + 2 * trgValQ[10 * i + 9];
+        const double x3 = (trgCoord[3 * i + 2] - 0.5) / sF;
+        const double *rpy = trgValRPY.data() + 20 * i;
+        const double *lapSDQ = rpy + 6;  // p, grad p, gradgrad p
+        const double *lapSDZ = rpy + 16; // p, grad p
+        trgValueInternal[6 * i + 0] = rpy[0] + lapSDZ[1] + x3 * lapSDQ[1];
+        trgValueInternal[6 * i + 1] = rpy[1] + lapSDZ[2] + x3 * lapSDQ[2];
+        trgValueInternal[6 * i + 2] = rpy[2] + lapSDZ[3] + x3 * lapSDQ[3] - lapSDQ[0];
+        trgValueInternal[6 * i + 3] = rpy[3] + 2 * lapSDQ[6];
+        trgValueInternal[6 * i + 4] = rpy[4] + 2 * lapSDQ[8];
+        trgValueInternal[6 * i + 5] = rpy[5] + 2 * lapSDQ[9];
     }
 }
 
@@ -0,0 +1,77 @@
+#include "STKFMM/TaskQueue.hpp"
+
+#include <iostream>
+
+#include <mpi.h>
+#include <omp.h>
+
+namespace stkfmm {
+namespace impl {
+
+TaskQueue::TaskQueue(int nThreads_) : nThreads(nThreads_) {
+    if (threaded())
+        worker = std::thread(&TaskQueue::run, this);
+}
+
+TaskQueue::~TaskQueue() {
+    if (!worker.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    cv.notify_one();
+    worker.join();
+}
+
+void TaskQueue::run() {
+    omp_set_num_threads(nThreads);
+    while (true) {
+        std::packaged_task<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cv.wait(lock, [this] { return stop || !tasks.empty(); });
+            // pending tasks are finished before stopping
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+bool TaskQueue::threaded() {
+    static const bool multiple = []() {
+        int provided;
+        MPI_Query_thread(&provided);
+        if (provided != MPI_THREAD_MULTIPLE) {
+            int rank;
+            MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+            if (rank == 0)
+                std::cout << "MPI_THREAD_MULTIPLE not provided, asynchronous FMM calls run synchronously"
+                          << std::endl;
+        }
+        return provided == MPI_THREAD_MULTIPLE;
+    }();
+    return multiple;
+}
+
+std::future<void> TaskQueue::submit(std::function<void()> task) {
+    std::packaged_task<void()> ptask(std::move(task));
+    auto future = ptask.get_future();
+    if (!worker.joinable()) {
+        ptask();
+        return future;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        tasks.push_back(std::move(ptask));
+    }
+    cv.notify_one();
+    return future;
+}
+
+} // namespace impl
+} // namespace stkfmm
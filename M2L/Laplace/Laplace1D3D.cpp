@@ -27,6 +27,13 @@ double gKernelFF(const EVec3 &target, const EVec3 &source, const int directTerm
     return potentialDirect;
 }
 
+// periodic far field from one M equivalent point to one L check point, a block of M2C
+EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint) {
+    EMat W(1, 1);
+    W(0, 0) = gKernelFF(Cpoint, Mpoint); // sum the images
+    return W;
+}
+
 int main(int argc, char **argv) {
     Eigen::initParallel();
     Eigen::setNbThreads(1);
@@ -73,7 +80,7 @@ int main(int argc, char **argv) {
         EVec f(checkN);
         for (int k = 0; k < checkN; k++) {
             EVec3 Cpoint(pointLCheck[3 * k], pointLCheck[3 * k + 1], pointLCheck[3 * k + 2]);
-            f(k) = gKernelFF(Cpoint, Mpoint); // sum the images
+            f(k) = M2CBlock(Cpoint, Mpoint)(0, 0);
         }
         M2C.col(i) = f;
         M2L.col(i) = (ALpinvU.transpose() * (ALpinvVT.transpose() * f));
@@ -83,8 +90,8 @@ int main(int argc, char **argv) {
 
     std::cout << "Precomputing time:" << duration / 1e6 << std::endl;
 
-    saveEMat(M2L, "M2L_laplace_1D3D_p" + std::to_string(pEquiv));
-    saveEMat(M2C, "M2C_laplace_1D3D_p" + std::to_string(pEquiv));
+    saveEMat(M2L, "M2L", "laplace", 1, pEquiv);
+    saveEMat(M2C, "M2C", "laplace", 1, pEquiv);
 
     EMat AM(kdim[0] * checkN, kdim[1] * equivN); // M den to M check
     EMat AMpinvU(AM.cols(), AM.rows());
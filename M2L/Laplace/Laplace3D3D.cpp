@@ -221,6 +221,14 @@ inline EVec4 ggradKernelFF(const EVec3 &target, const EVec3 &source) {
     return fEwald;
 }
 
+// periodic far field from one M equivalent point to one L check point, a block of M2C
+EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint) {
+    const EVec3 Npoint(0.5, 0.5, 0.5); // neutralizing
+    EMat W(1, 1);
+    W(0, 0) = gKernelFF(Cpoint, Mpoint) - gKernelFF(Cpoint, Npoint); // sum the images
+    return W;
+}
+
 int main(int argc, char **argv) {
     Eigen::initParallel();
     Eigen::setNbThreads(1);
@@ -263,12 +271,11 @@ int main(int argc, char **argv) {
 #pragma omp parallel for
     for (int i = 0; i < equivN; i++) {
         const EVec3 Mpoint(pointMEquiv[3 * i], pointMEquiv[3 * i + 1], pointMEquiv[3 * i + 2]);
-        const EVec3 Npoint(0.5, 0.5, 0.5); // neutralizing
 
         EVec f(checkN);
         for (int k = 0; k < checkN; k++) {
             EVec3 Cpoint(pointLCheck[3 * k], pointLCheck[3 * k + 1], pointLCheck[3 * k + 2]);
-            f(k) = gKernelFF(Cpoint, Mpoint) - gKernelFF(Cpoint, Npoint); // sum the images
+            f(k) = M2CBlock(Cpoint, Mpoint)(0, 0);
         }
         M2C.col(i) = f;
         M2L.col(i) = (ALpinvU.transpose() * (ALpinvVT.transpose() * f));
@@ -278,8 +285,8 @@ int main(int argc, char **argv) {
 
     std::cout << "Precomputing time:" << duration / 1e6 << std::endl;
 
-    saveEMat(M2L, "M2L_laplace_3D3D_p" + std::to_string(pEquiv));
-    saveEMat(M2C, "M2C_laplace_3D3D_p" + std::to_string(pEquiv));
+    saveEMat(M2L, "M2L", "laplace", 3, pEquiv);
+    saveEMat(M2C, "M2C", "laplace", 3, pEquiv);
 
     EMat AM(kdim[0] * checkN, kdim[1] * equivN); // M den to M check
     EMat AMpinvU(AM.cols(), AM.rows());
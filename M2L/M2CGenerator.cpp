@@ -0,0 +1,87 @@
+/*
+ * M2CGenerator.cpp
+ *
+ * runs the far field kernels of the M2L generators over all M equivalent points
+ */
+
+#include "M2CGenerator.hpp"
+#include "SVD_pvfmm.hpp"
+
+#include <functional>
+
+// clang-format off
+namespace Laplace1D3D { EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint); }
+namespace Laplace2D3D { EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint); }
+namespace Laplace3D3D { EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint); }
+namespace Stokes1D3D { EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint); }
+namespace Stokes2D3D { EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint); }
+namespace Stokes3D3D { EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint); }
+namespace StokesPVel1D3D { EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint); }
+namespace StokesPVel2D3D { EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint); }
+namespace StokesPVel3D3D { EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint); }
+// clang-format on
+
+namespace stkfmm {
+
+bool generateM2C(const std::string &kernel, int pbc, int order, MPI_Comm comm, std::vector<double> &M2C) {
+    using BlockFunc = std::function<EMat(const EVec3 &, const EVec3 &)>;
+    int kdim = 0;
+    BlockFunc block;
+    if (kernel == "laplace") {
+        kdim = 1;
+        block = pbc == 1 ? Laplace1D3D::M2CBlock : (pbc == 2 ? Laplace2D3D::M2CBlock : Laplace3D3D::M2CBlock);
+    } else if (kernel == "stokes_vel") {
+        kdim = 3;
+        block = pbc == 1 ? Stokes1D3D::M2CBlock : (pbc == 2 ? Stokes2D3D::M2CBlock : Stokes3D3D::M2CBlock);
+    } else if (kernel == "stokes_PVel") {
+        kdim = 4;
+        block = pbc == 1 ? StokesPVel1D3D::M2CBlock
+                         : (pbc == 2 ? StokesPVel2D3D::M2CBlock : StokesPVel3D3D::M2CBlock);
+    }
+    if (kdim == 0 || pbc < 1 || pbc > 3 || order < 2) {
+        return false;
+    }
+
+    int rank, nProcs;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &nProcs);
+
+    const double pCenterMEquiv[3] = {-(scaleIn - 1) / 2, -(scaleIn - 1) / 2, -(scaleIn - 1) / 2};
+    const double pCenterLCheck[3] = {-(scaleIn - 1) / 2, -(scaleIn - 1) / 2, -(scaleIn - 1) / 2};
+    auto pointMEquiv = surface(order, (double *)&(pCenterMEquiv[0]), scaleIn, 0);
+    auto pointLCheck = surface(order, (double *)&(pCenterLCheck[0]), scaleIn, 0);
+    const int equivN = pointMEquiv.size() / 3;
+    const int checkN = pointLCheck.size() / 3;
+    const int nRow = kdim * checkN;
+    const int nColBlock = nRow * kdim; // entries of the kdim columns of one M point
+
+    // contiguous range of M points on each rank
+    std::vector<int> counts(nProcs), displs(nProcs);
+    for (int r = 0; r < nProcs; r++) {
+        const int low = (long(equivN) * r) / nProcs;
+        const int high = (long(equivN) * (r + 1)) / nProcs;
+        counts[r] = (high - low) * nColBlock;
+        displs[r] = low * nColBlock;
+    }
+    const int iLow = displs[rank] / nColBlock;
+    const int iHigh = iLow + counts[rank] / nColBlock;
+
+    EMat local(nRow, kdim * (iHigh - iLow));
+#pragma omp parallel for schedule(dynamic)
+    for (int i = iLow; i < iHigh; i++) {
+        const EVec3 Mpoint(pointMEquiv[3 * i], pointMEquiv[3 * i + 1], pointMEquiv[3 * i + 2]);
+        for (int k = 0; k < checkN; k++) {
+            const EVec3 Cpoint(pointLCheck[3 * k], pointLCheck[3 * k + 1], pointLCheck[3 * k + 2]);
+            local.block(kdim * k, kdim * (i - iLow), kdim, kdim) = block(Cpoint, Mpoint);
+        }
+    }
+
+    // EMat is column-major, so the columns of each rank are contiguous in M2C
+    if (rank == 0)
+        M2C.resize(size_t(nRow) * kdim * equivN);
+    MPI_Gatherv(local.data(), counts[rank], MPI_DOUBLE, M2C.data(), counts.data(), displs.data(), MPI_DOUBLE, 0,
+                comm);
+    return true;
+}
+
+} // namespace stkfmm
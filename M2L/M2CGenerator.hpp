@@ -0,0 +1,33 @@
+/*
+ * M2CGenerator.hpp
+ *
+ * library interface to the periodic M2C operator generators,
+ * used by STKFMM to generate missing operators at runtime
+ */
+
+#ifndef M2CGENERATOR_HPP_
+#define M2CGENERATOR_HPP_
+
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+namespace stkfmm {
+
+/**
+ * @brief compute the periodic M2C operator for a pvfmm m2l kernel
+ * collective on comm, columns are distributed over ranks and computed with OpenMP threads
+ *
+ * @param kernel pvfmm m2l kernel name, one of laplace, stokes_vel, stokes_PVel
+ * @param pbc periodicity 1,2,3
+ * @param order multipole order
+ * @param comm MPI communicator
+ * @param M2C [out] on rank 0 of comm, the square operator in column-major order
+ * @return false if the kernel or periodicity is not supported
+ */
+bool generateM2C(const std::string &kernel, int pbc, int order, MPI_Comm comm, std::vector<double> &M2C);
+
+} // namespace stkfmm
+
+#endif
@@ -20,6 +20,8 @@
 
 #include <Eigen/Dense>
 
+#include "STKFMM/OperatorFile.hpp"
+
 using EVec2 = Eigen::Vector2d;
 using EVec3 = Eigen::Vector3d;
 using EVec4 = Eigen::Vector4d;
@@ -37,8 +39,22 @@ constexpr int SUM1D = 500000;
 constexpr double scaleIn = 1.05;
 constexpr double scaleOut = 2.95;
 
+/**
+ * @brief save a periodic operator as text file <name> and binary file <name>.bin
+ *
+ * @param mat operator matrix
+ * @param type "M2C" or "M2L"
+ * @param kernel pvfmm m2l kernel name
+ * @param pbc periodicity 1,2,3
+ * @param order multipole order
+ */
 template <class Matrix>
-void saveEMat(const Matrix &mat, const std::string &fname) {
+void saveEMat(const Matrix &mat, const std::string &type, const std::string &kernel, int pbc, int order) {
+    const std::string fname = stkfmm::operatorName(type, kernel, pbc, order);
+    const EMat colMajor = mat;
+    stkfmm::writeOperator(fname + ".bin", type, kernel, pbc, order, colMajor.rows(), colMajor.cols(),
+                          colMajor.data());
+
     FILE *fptr = fopen(fname.c_str(), "w");
     const int M = mat.rows();
     const int N = mat.cols();
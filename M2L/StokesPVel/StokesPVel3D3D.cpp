@@ -401,6 +401,13 @@ void testTranslation() {
     }
 }
 
+// periodic far field from one M equivalent point to one L check point, a block of M2C
+EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint) {
+    EMat4 W = EMat4::Zero();
+    WkernelFF(Cpoint, Mpoint, W);
+    return W;
+}
+
 int main(int argc, char **argv) {
     Eigen::initParallel();
     Eigen::setNbThreads(1);
@@ -450,9 +457,7 @@ int main(int argc, char **argv) {
         EMat f(kdim[0] * checkN, kdim[1]);
         for (int k = 0; k < checkN; k++) {
             EVec3 Cpoint(pointLCheck[3 * k], pointLCheck[3 * k + 1], pointLCheck[3 * k + 2]);
-            EMat4 W = EMat4::Zero();
-            WkernelFF(Cpoint, Mpoint, W);
-            f.block<kdim[0], kdim[1]>(kdim[0] * k, 0) = W;
+            f.block<kdim[0], kdim[1]>(kdim[0] * k, 0) = M2CBlock(Cpoint, Mpoint);
         }
         M2C.block(0, kdim[1] * i, kdim[0] * checkN, kdim[1]) = f;
         M2L.block(0, kdim[1] * i, kdim[0] * checkN, kdim[1]) = (ALpinvU.transpose() * (ALpinvVT.transpose() * f));
@@ -462,8 +467,8 @@ int main(int argc, char **argv) {
 
     std::cout << "Precomputing time:" << duration / 1e6 << std::endl;
 
-    saveEMat(M2L, "M2L_stokes_PVel_3D3D_p" + std::to_string(pEquiv));
-    saveEMat(M2C, "M2C_stokes_PVel_3D3D_p" + std::to_string(pEquiv));
+    saveEMat(M2L, "M2L", "stokes_PVel", 3, pEquiv);
+    saveEMat(M2C, "M2C", "stokes_PVel", 3, pEquiv);
 
     EMat AM(kdim[0] * checkN, kdim[1] * equivN); // M den to M check
     EMat AMpinvU(AM.cols(), AM.rows());
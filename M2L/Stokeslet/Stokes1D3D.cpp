@@ -43,6 +43,13 @@ inline void GkernelFF(const EVec3 &rvec, EMat3 &GFF) {
     }
 }
 
+// periodic far field from one M equivalent point to one L check point, a block of M2C
+EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint) {
+    EMat3 G = EMat3::Zero();
+    GkernelFF(Cpoint - Mpoint, G);
+    return G;
+}
+
 // calculate the M2L matrix of images from 2 to 1000
 int main(int argc, char **argv) {
     Eigen::initParallel();
@@ -92,9 +99,7 @@ int main(int argc, char **argv) {
         EMat f(3 * checkN, 3);
         for (int k = 0; k < checkN; k++) {
             EVec3 Cpoint(pointLCheck[3 * k], pointLCheck[3 * k + 1], pointLCheck[3 * k + 2]);
-            EMat3 G = EMat3::Zero();
-            GkernelFF(Cpoint - Mpoint, G);
-            f.block<kdim[0], kdim[1]>(3 * k, 0) = G;
+            f.block<kdim[0], kdim[1]>(3 * k, 0) = M2CBlock(Cpoint, Mpoint);
         }
         M2C.block(0, 3 * i, 3 * checkN, 3) = f;
         M2L.block(0, 3 * i, 3 * checkN, 3) = (ALpinvU.transpose() * (ALpinvVT.transpose() * f));
@@ -104,8 +109,8 @@ int main(int argc, char **argv) {
 
     std::cout << "Precomputing time:" << duration / 1e6 << std::endl;
 
-    saveEMat(M2L, "M2L_stokes_vel_1D3D_p" + std::to_string(pEquiv));
-    saveEMat(M2C, "M2C_stokes_vel_1D3D_p" + std::to_string(pEquiv));
+    saveEMat(M2L, "M2L", "stokes_vel", 1, pEquiv);
+    saveEMat(M2C, "M2C", "stokes_vel", 1, pEquiv);
 
     EMat AM(kdim[0] * checkN, kdim[1] * equivN); // M den to M check
     EMat AMpinvU(AM.cols(), AM.rows());
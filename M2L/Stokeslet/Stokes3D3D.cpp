@@ -102,6 +102,13 @@ inline void GkernelFF(const EVec3 &rvec, EMat3 &GFF) {
     GFF -= GNF;
 }
 
+// periodic far field from one M equivalent point to one L check point, a block of M2C
+EMat M2CBlock(const EVec3 &Cpoint, const EVec3 &Mpoint) {
+    EMat3 G = EMat3::Zero();
+    GkernelFF(Cpoint - Mpoint, G);
+    return G;
+}
+
 int main(int argc, char **argv) {
     Eigen::initParallel();
     Eigen::setNbThreads(1);
@@ -150,9 +157,7 @@ int main(int argc, char **argv) {
         EMat f(3 * checkN, 3);
         for (int k = 0; k < checkN; k++) {
             EVec3 Cpoint(pointLCheck[3 * k], pointLCheck[3 * k + 1], pointLCheck[3 * k + 2]);
-            EMat3 G = EMat3::Zero();
-            GkernelFF(Cpoint - Mpoint, G);
-            f.block<kdim[0], kdim[1]>(3 * k, 0) = G;
+            f.block<kdim[0], kdim[1]>(3 * k, 0) = M2CBlock(Cpoint, Mpoint);
         }
         M2C.block(0, 3 * i, 3 * checkN, 3) = f;
         M2L.block(0, 3 * i, 3 * checkN, 3) = (ALpinvU.transpose() * (ALpinvVT.transpose() * f));
@@ -162,8 +167,8 @@ int main(int argc, char **argv) {
 
     std::cout << "Precomputing time:" << duration / 1e6 << std::endl;
 
-    saveEMat(M2L, "M2L_stokes_vel_3D3D_p" + std::to_string(pEquiv));
-    saveEMat(M2C, "M2C_stokes_vel_3D3D_p" + std::to_string(pEquiv));
+    saveEMat(M2L, "M2L", "stokes_vel", 3, pEquiv);
+    saveEMat(M2C, "M2C", "stokes_vel", 3, pEquiv);
 
     EMat AM(kdim[0] * checkN, kdim[1] * equivN); // M den to M check
     EMat AMpinvU(AM.cols(), AM.rows());
@@ -0,0 +1,80 @@
+/*
+ * convert.cpp
+ *
+ * convert text operator files M2C_<kernel>_<pbc>D3D_p<order> (or M2L_...)
+ * written by older versions of the generators to the binary format <name>.bin
+ */
+
+#include "STKFMM/OperatorFile.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// parse M2C_stokes_PVel_3D3D_p10 into type, kernel, pbc, order
+bool parseName(const std::string &name, std::string &type, std::string &kernel, int &pbc, int &order) {
+    const auto first = name.find('_');
+    const auto last = name.rfind("D3D_p");
+    if (first == std::string::npos || last == std::string::npos || last < first + 3)
+        return false;
+    type = name.substr(0, first);
+    kernel = name.substr(first + 1, last - first - 3);
+    pbc = atoi(name.substr(last - 1, 1).c_str());
+    order = atoi(name.substr(last + 5).c_str());
+    return (type == "M2C" || type == "M2L") && !kernel.empty() && pbc >= 1 && pbc <= 3 && order > 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        std::cerr << "Input: {text operator file} ...\n";
+        return 1;
+    }
+
+    int ret = 0;
+    for (int k = 1; k < argc; k++) {
+        const std::string file = argv[k];
+        const auto slash = file.rfind('/');
+        const std::string name = slash == std::string::npos ? file : file.substr(slash + 1);
+
+        std::string type, kernel;
+        int pbc, order;
+        if (!parseName(name, type, kernel, pbc, order)) {
+            std::cerr << "cannot parse operator name " << name << std::endl;
+            ret = 1;
+            continue;
+        }
+
+        // size of the square operator from the number of lines
+        FILE *fin = fopen(file.c_str(), "r");
+        if (fin == nullptr) {
+            std::cerr << file << " not found" << std::endl;
+            ret = 1;
+            continue;
+        }
+        size_t lines = 0;
+        for (int c = fgetc(fin); c != EOF; c = fgetc(fin))
+            lines += (c == '\n');
+        fclose(fin);
+        const int dim = std::lround(std::sqrt(double(lines)));
+
+        std::vector<double> data;
+        if (size_t(dim) * dim != lines || !stkfmm::readTextOperator(file, dim, data)) {
+            std::cerr << file << " is not a square text operator" << std::endl;
+            ret = 1;
+            continue;
+        }
+        if (!stkfmm::writeOperator(file + ".bin", type, kernel, pbc, order, dim, dim, data.data())) {
+            ret = 1;
+            continue;
+        }
+        // read back with the checksum, the library skips it when mapping
+        stkfmm::OperatorMatrix check;
+        if (!check.map(file + ".bin", type, kernel, pbc, order, dim, true)) {
+            ret = 1;
+            continue;
+        }
+        std::cout << file << " -> " << file << ".bin, " << dim << "x" << dim << std::endl;
+    }
+    return ret;
+}
@@ -31,6 +31,15 @@ class KERNEL(enum.IntFlag):
     Traction = 1024  # Stokes
 
 
+# timed phases of each kernel, in the order of the C++ enum PHASE
+PHASES = ['ingest', 'treeBuild', 'setupFMM', 'fmm', 'periodize', 'scaling', 'copyOut']
+
+
+def release_operators():
+    # free the shared periodic operators no FMM object uses, collective over MPI_COMM_WORLD
+    lib.STKFMM_release_operators()
+
+
 class Stk3DFMM():
     def __init__(self, mult_order, max_pts, pbc, kernels):
         self.mult_order = c_int(mult_order)
@@ -60,6 +69,15 @@ class Stk3DFMM():
                                 c_int(src_DL_coord.shape[0]),
                                 src_DL_coord.ctypes.data_as(POINTER(c_double)))
 
+    def update_points(self, src_SL_coord, trg_coord, src_DL_coord):
+        return bool(lib.Stk3DFMM_update_points(self.fmm,
+                                               c_int(src_SL_coord.shape[0]),
+                                               src_SL_coord.ctypes.data_as(POINTER(c_double)),
+                                               c_int(trg_coord.shape[0]),
+                                               trg_coord.ctypes.data_as(POINTER(c_double)),
+                                               c_int(src_DL_coord.shape[0]),
+                                               src_DL_coord.ctypes.data_as(POINTER(c_double))))
+
     def evaluate_fmm(self, kernel, src_SL_value, trg_value, src_DL_value):
         lib.Stk3DFMM_evaluate_fmm(self.fmm, c_int(kernel),
                                   c_int(src_SL_value.shape[0]),
@@ -69,6 +87,17 @@ class Stk3DFMM():
                                   c_int(src_DL_value.shape[0]),
                                   src_DL_value.ctypes.data_as(POINTER(c_double)))
 
+    def evaluate_fmm_batch(self, kernel, src_SL_value, trg_value, src_DL_value):
+        # values of shape (points, sets, kernel dimension)
+        lib.Stk3DFMM_evaluate_fmm_batch(self.fmm, c_int(kernel),
+                                        c_int(src_SL_value.shape[1]),
+                                        c_int(src_SL_value.shape[0]),
+                                        src_SL_value.ctypes.data_as(POINTER(c_double)),
+                                        c_int(trg_value.shape[0]),
+                                        trg_value.ctypes.data_as(POINTER(c_double)),
+                                        c_int(src_DL_value.shape[0]),
+                                        src_DL_value.ctypes.data_as(POINTER(c_double)))
+
     def setup_tree(self, kernel):
         lib.Stk3DFMM_setup_tree(self.fmm, c_int(kernel))
 
@@ -78,6 +107,21 @@ class Stk3DFMM():
     def show_active_kernels(self):
         lib.Stk3DFMM_show_active_kernels(self.fmm)
 
+    def get_perf_counters(self, kernel):
+        # {phase: (min, avg, max)} wall time over ranks in seconds, collective
+        t = np.zeros((3, len(PHASES)))
+        lib.Stk3DFMM_get_perf_counters(self.fmm, c_int(kernel),
+                                    t[0].ctypes.data_as(POINTER(c_double)),
+                                    t[1].ctypes.data_as(POINTER(c_double)),
+                                    t[2].ctypes.data_as(POINTER(c_double)))
+        return {name: tuple(t[:, i]) for i, name in enumerate(PHASES)}
+
+    def reset_perf_counters(self):
+        lib.Stk3DFMM_reset_perf_counters(self.fmm)
+
+    def dump_perf_counters(self, filename):
+        lib.Stk3DFMM_dump_perf_counters(self.fmm, filename.encode())
+
 
 class StkWallFMM():
     def __init__(self, mult_order, max_pts, pbc, kernels):
@@ -117,6 +161,17 @@ class StkWallFMM():
                                     c_int(src_DL_value.shape[0]),
                                     src_DL_value.ctypes.data_as(POINTER(c_double)))
 
+    def evaluate_fmm_batch(self, kernel, src_SL_value, trg_value, src_DL_value):
+        # values of shape (points, sets, kernel dimension)
+        lib.StkWallFMM_evaluate_fmm_batch(self.fmm, c_int(kernel),
+                                          c_int(src_SL_value.shape[1]),
+                                          c_int(src_SL_value.shape[0]),
+                                          src_SL_value.ctypes.data_as(POINTER(c_double)),
+                                          c_int(trg_value.shape[0]),
+                                          trg_value.ctypes.data_as(POINTER(c_double)),
+                                          c_int(src_DL_value.shape[0]),
+                                          src_DL_value.ctypes.data_as(POINTER(c_double)))
+
     def setup_tree(self, kernel):
         lib.StkWallFMM_setup_tree(self.fmm, c_int(kernel))
 
@@ -126,6 +181,21 @@ class StkWallFMM():
     def show_active_kernels(self):
         lib.StkWallFMM_show_active_kernels(self.fmm)
 
+    def get_perf_counters(self, kernel):
+        # {phase: (min, avg, max)} wall time over ranks in seconds, collective
+        t = np.zeros((3, len(PHASES)))
+        lib.StkWallFMM_get_perf_counters(self.fmm, c_int(kernel),
+                                    t[0].ctypes.data_as(POINTER(c_double)),
+                                    t[1].ctypes.data_as(POINTER(c_double)),
+                                    t[2].ctypes.data_as(POINTER(c_double)))
+        return {name: tuple(t[:, i]) for i, name in enumerate(PHASES)}
+
+    def reset_perf_counters(self):
+        lib.StkWallFMM_reset_perf_counters(self.fmm)
+
+    def dump_perf_counters(self, filename):
+        lib.StkWallFMM_dump_perf_counters(self.fmm, filename.encode())
+
 
 class DArray():
     def __init__(self, array):
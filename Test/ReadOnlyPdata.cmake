@@ -0,0 +1,29 @@
+# Periodic M2C generated in memory because $PVFMM_DIR/pdata is not writable, read by node leaders.
+# Each rank is its own node, so every rank except 0 would look for a file that does not exist.
+#
+# cmake -DTESTFMM=<TestFMM.X> -DCONFIG=<Verify.toml> -DMPIEXEC=<mpiexec> -DNPROCS=<n> -DWORKDIR=<dir>
+#       -P ReadOnlyPdata.cmake
+
+file(REMOVE_RECURSE ${WORKDIR})
+file(MAKE_DIRECTORY ${WORKDIR}/pdata ${WORKDIR}/cache)
+execute_process(COMMAND chmod 555 ${WORKDIR}/pdata)
+
+# root ignores the permission, put a file in the way instead
+execute_process(COMMAND touch ${WORKDIR}/pdata/probe RESULT_VARIABLE writable)
+if(writable EQUAL 0)
+  file(REMOVE_RECURSE ${WORKDIR}/pdata)
+  file(WRITE ${WORKDIR}/pdata "not a directory\n")
+endif()
+
+execute_process(
+  COMMAND
+    ${CMAKE_COMMAND} -E env PVFMM_DIR=${WORKDIR} STKFMM_CACHE_DIR=${WORKDIR}/cache
+    STKFMM_OPERATOR_READER=node STKFMM_RANKS_PER_NODE=1 ${MPIEXEC} -n ${NPROCS} ${TESTFMM} --config
+    ${CONFIG} -P 1 -K 8 -M 8 --verify --no-convergence
+  WORKING_DIRECTORY ${WORKDIR}
+  RESULT_VARIABLE result)
+
+execute_process(COMMAND chmod -R 755 ${WORKDIR})
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "TestFMM.X failed with a read-only pdata and node readers: ${result}")
+endif()
@@ -1225,4 +1225,130 @@ void LaplaceQPGradGrad(double *s, double *t, double *q, double *pgradgrad) {
                         (5 * dy * dz * (q5 + q7) + Power(dy, 2) * (q0 + q4 - 2 * q8) +
                          Power(dz, 2) * (-9 * q0 + q4 + 8 * q8)))) /
              Power(Power(dx, 2) + Power(dy, 2) + Power(dz, 2), 4.5));
-}
\ No newline at end of file
+}
+// derivatives of 1/R and R, R != 0
+static double Delta(int i, int j) { return i == j ? 1.0 : 0.0; }
+
+static double D1InvR(const double *R, int i) {
+    const double rinv = 1 / Sqrt(R[0] * R[0] + R[1] * R[1] + R[2] * R[2]);
+    return -R[i] * rinv * rinv * rinv;
+}
+
+static double D2InvR(const double *R, int i, int j) {
+    const double rinv = 1 / Sqrt(R[0] * R[0] + R[1] * R[1] + R[2] * R[2]);
+    const double rinv3 = rinv * rinv * rinv;
+    return 3 * R[i] * R[j] * rinv3 * rinv * rinv - Delta(i, j) * rinv3;
+}
+
+static double D3InvR(const double *R, int i, int j, int k) {
+    const double rinv = 1 / Sqrt(R[0] * R[0] + R[1] * R[1] + R[2] * R[2]);
+    const double rinv5 = Power(rinv, 5);
+    return -15 * R[i] * R[j] * R[k] * rinv5 * rinv * rinv +
+           3 * (Delta(i, j) * R[k] + Delta(i, k) * R[j] + Delta(j, k) * R[i]) * rinv5;
+}
+
+static double D4InvR(const double *R, int i, int j, int k, int l) {
+    const double rinv = 1 / Sqrt(R[0] * R[0] + R[1] * R[1] + R[2] * R[2]);
+    const double rinv5 = Power(rinv, 5);
+    const double rinv7 = rinv5 * rinv * rinv;
+    return 105 * R[i] * R[j] * R[k] * R[l] * rinv7 * rinv * rinv -
+           15 *
+               (Delta(i, j) * R[k] * R[l] + Delta(i, k) * R[j] * R[l] + Delta(i, l) * R[j] * R[k] +
+                Delta(j, k) * R[i] * R[l] + Delta(j, l) * R[i] * R[k] + Delta(k, l) * R[i] * R[j]) *
+               rinv7 +
+           3 * (Delta(i, j) * Delta(k, l) + Delta(i, k) * Delta(j, l) + Delta(i, l) * Delta(j, k)) * rinv5;
+}
+
+static double D3R(const double *R, int i, int j, int k) {
+    const double rinv = 1 / Sqrt(R[0] * R[0] + R[1] * R[1] + R[2] * R[2]);
+    const double rinv3 = rinv * rinv * rinv;
+    return -(Delta(i, j) * R[k] + Delta(i, k) * R[j] + Delta(j, k) * R[i]) * rinv3 +
+           3 * R[i] * R[j] * R[k] * rinv3 * rinv * rinv;
+}
+
+static double D4R(const double *R, int i, int j, int k, int l) {
+    const double rinv = 1 / Sqrt(R[0] * R[0] + R[1] * R[1] + R[2] * R[2]);
+    const double rinv3 = rinv * rinv * rinv;
+    const double rinv5 = rinv3 * rinv * rinv;
+    return -(Delta(i, j) * Delta(k, l) + Delta(i, k) * Delta(j, l) + Delta(i, l) * Delta(j, k)) * rinv3 +
+           3 *
+               (Delta(i, j) * R[k] * R[l] + Delta(i, k) * R[j] * R[l] + Delta(i, l) * R[j] * R[k] +
+                Delta(j, k) * R[i] * R[l] + Delta(j, l) * R[i] * R[k] + Delta(k, l) * R[i] * R[j]) *
+               rinv5 -
+           15 * R[i] * R[j] * R[k] * R[l] * rinv5 * rinv * rinv;
+}
+
+// Stokeslet velocity S f and its Laplacian, without 1/(8 pi)
+static void StokesletLap(const double *r, const double *f, double *vel, double *lap) {
+    const double r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+    const double rinv = 1 / Sqrt(r2);
+    const double rinv3 = rinv / r2;
+    const double rinv5 = rinv3 / r2;
+    const double fdotr = f[0] * r[0] + f[1] * r[1] + f[2] * r[2];
+    for (int i = 0; i < 3; i++) {
+        vel[i] = f[i] * rinv + r[i] * fdotr * rinv3;
+        lap[i] = 2 * f[i] * rinv3 - 6 * fdotr * r[i] * rinv5;
+    }
+}
+
+// Blake solution G f of a Stokeslet above a no-slip wall at z = 0, without 1/(8 pi)
+// G f = S(r) f - S(R) f + C, r = t - s, R = t - s*, s* = (s1,s2,-s3), h = s3, g = (f1,f2,-f3)
+// C_i = -2 h^2 g_k d_i d_k (1/R) - 2 h g_k (2 delta_i3 d_k (1/R) - d_i d_k d_3 R)
+// lapS, lapT, lapST are the Laplacians of G f over source, target and both coordinates
+static void StokesWallImage(double *s, double *t, double *f, double *vel, double *lapS, double *lapT,
+                            double *lapST) {
+    const double h = s[2];
+    const double r[3] = {t[0] - s[0], t[1] - s[1], t[2] - s[2]};
+    const double R[3] = {t[0] - s[0], t[1] - s[1], t[2] + s[2]};
+    const double g[3] = {f[0], f[1], -f[2]};
+
+    double velr[3], lapr[3], velR[3], lapR[3];
+    StokesletLap(r, f, velr, lapr);
+    StokesletLap(R, f, velR, lapR);
+
+    for (int i = 0; i < 3; i++) {
+        double c = 0, cS = 0, cT = 0, cST = 0;
+        for (int k = 0; k < 3; k++) {
+            c += -2 * h * h * g[k] * D2InvR(R, i, k) -
+                 2 * h * g[k] * (2 * Delta(i, 2) * D1InvR(R, k) - D3R(R, i, k, 2));
+            cS += -4 * g[k] * D2InvR(R, i, k) - 4 * h * g[k] * D3InvR(R, i, k, 2) -
+                  8 * Delta(i, 2) * g[k] * D2InvR(R, k, 2) + 4 * g[k] * D4R(R, i, k, 2, 2);
+            cT += 4 * h * g[k] * D3InvR(R, i, k, 2);
+            cST += 8 * g[k] * D4InvR(R, i, k, 2, 2);
+        }
+        vel[i] = velr[i] - velR[i] + c;
+        lapS[i] = lapr[i] - lapR[i] + cS;
+        lapT[i] = lapr[i] - lapR[i] + cT;
+        lapST[i] = cST;
+    }
+}
+
+void StokesSLWall(double *s, double *t, double *f, double *v) {
+    const double dx = t[0] - s[0];
+    const double dy = t[1] - s[1];
+    const double dz = t[2] - s[2];
+    if (dx * dx + dy * dy + dz * dz == 0.0)
+        return;
+
+    double vel[3], lapS[3], lapT[3], lapST[3];
+    StokesWallImage(s, t, f, vel, lapS, lapT, lapST);
+    for (int i = 0; i < 3; i++)
+        v[i] += vel[i] / (8.0 * M_PI);
+}
+
+void StokesSLRPYWall(double *s, double *t, double *f, double *vlapv) {
+    const double dx = t[0] - s[0];
+    const double dy = t[1] - s[1];
+    const double dz = t[2] - s[2];
+    if (dx * dx + dy * dy + dz * dz == 0.0)
+        return;
+
+    // (1 + b^2/6 lap_s) G f and lap_t of it
+    const double b2 = f[3] * f[3];
+    double vel[3], lapS[3], lapT[3], lapST[3];
+    StokesWallImage(s, t, f, vel, lapS, lapT, lapST);
+    for (int i = 0; i < 3; i++) {
+        vlapv[i] += (vel[i] + b2 / 6.0 * lapS[i]) / (8.0 * M_PI);
+        vlapv[3 + i] += (lapT[i] + b2 / 6.0 * lapST[i]) / (8.0 * M_PI);
+    }
+}
@@ -42,6 +42,11 @@ void StokesDLRPY(double *s, double *t, double *f, double *vlapv);
 void StokesSL(double *s, double *t, double *f, double *v);
 void StokesDL(double *s, double *t, double *f, double *v);
 
+// above a no-slip wall at z = 0
+//                         3           3           3/4           3/6
+void StokesSLWall(double *s, double *t, double *f, double *v);
+void StokesSLRPYWall(double *s, double *t, double *f, double *vlapv);
+
 //
 
 #endif
@@ -22,6 +22,11 @@ std::unordered_map<KERNEL, std::pair<kernel_func, kernel_func>>
                 {KERNEL::Traction, std::make_pair(StokesSLTraction, StokesDLTraction)},
                 {KERNEL::PVelLaplacian, std::make_pair(StokesSLPVelLaplacian, StokesDLPVelLaplacian)}});
 
+// wall at z = 0
+std::unordered_map<KERNEL, std::pair<kernel_func, kernel_func>>
+    SL_wall_kernels({{KERNEL::Stokes, std::make_pair(StokesSLWall, nullptr)},
+                     {KERNEL::RPY, std::make_pair(StokesSLRPYWall, nullptr)}});
+
 void Config::parse(int argc, char **argv) {
     CLI::App app("Test Driver for Stk3DFMM and StkWallFMM\n");
     app.set_config("--config", "", "config file name");
@@ -50,9 +55,12 @@ void Config::parse(int argc, char **argv) {
                  "calculate convergence error relative to FMM at maxOrder");
     app.add_flag("--random,!--no-random", random, "use random points, otherwise regular mesh");
     app.add_flag("--dump,!--no-dump", dump, "write src/trg coord and values to files");
+    app.add_flag("--float,!--no-float", singlePrecision, "run FMM in single precision");
 
     // wall settings
     app.add_flag("--wall,!--no-wall", wall, "test StkWallFMM, otherwise Stk3DFMM");
+    app.add_flag("--noslip,!--no-noslip", noslip,
+                 "verify + wall checks zero velocity on the wall, otherwise O(N^2) wall image summation");
 
     // parse
     try {
@@ -68,9 +76,13 @@ void Config::parse(int argc, char **argv) {
             printf_rank0("PXYZ doesn't work for wall fmm\n");
             exit(1);
         }
-        if (verify) {
+        if (verify && noslip) {
             printf_rank0("Verify + wall checks no-slip condition only\n");
         }
+        if (verify && !noslip && pbc) {
+            printf_rank0("Verify + wall + no-noslip works for PNONE only\n");
+            exit(1);
+        }
         if (direct) {
             printf_rank0("option direct doesn't work for wall fmm\n");
             exit(1);
@@ -106,8 +118,11 @@ void Config::print() const {
     printf_rank0(verify ? "Show true error\n" : "");
     printf_rank0(convergence ? "Show convergence error\n" : "");
     printf_rank0(random ? "Random points\n" : "Regular mesh\n");
+    printf_rank0(singlePrecision ? "Single precision FMM\n" : "Double precision FMM\n");
 
     printf_rank0(wall ? "Testing StkWallFMM\n" : "Testing Stk3DFMM\n");
+    if (wall && verify)
+        printf_rank0(noslip ? "Verify no-slip on the wall\n" : "Verify with wall image summation\n");
 }
 
 ComponentError::ComponentError(const std::vector<double> &A, const std::vector<double> &B) {
@@ -231,7 +246,7 @@ void genPoint(const Config &config, Point &point, int dim) {
         scaleZ(point.srcLocalDL);
         scaleZ(point.trgLocal);
 
-        if (config.verify) {
+        if (config.verify && config.noslip) {
             // verify wall vel = 0.
             const int ntrg = point.trgLocal.size() / 3;
             for (int i = 0; i < ntrg; i++) {
@@ -308,6 +323,11 @@ void genSrcValue(const Config &config, const Point &point, Input &input) {
         if (kernelComb != 0 && !(asInteger(kernel) & kernelComb)) {
             continue;
         }
+        // used internally by StkWallFMM and Stk3DFMM, not activated by users
+        if (kernel == KERNEL::RPYWall || kernel == KERNEL::StokesLapPGrad || kernel == KERNEL::PVelTraction ||
+            kernel == KERNEL::StokesBatch || kernel == KERNEL::RPYBatch || kernel == KERNEL::LapPGradBatch) {
+            continue;
+        }
         Source value;
         int kdimSL, kdimDL, kdimTrg;
         std::tie(kdimSL, kdimDL, kdimTrg) = getKernelDimension(kernel);
@@ -440,6 +460,14 @@ void runSimpleKernel(const Config &config, const Point &point, Input &input, Res
     // trg remains distributed
     std::vector<double> trgCoordLocal = point.trgLocal;
 
+    // the wall image kernels put the wall at z = 0
+    auto shiftWall = [&](std::vector<double> &coord) {
+        if (config.wall)
+            for (size_t i = 0; i < coord.size() / 3; i++)
+                coord[3 * i + 2] -= config.origin[2];
+    };
+    shiftWall(trgCoordLocal);
+
     // loop over all activated kernels
     for (auto &data : input) {
         // create a copy for MPI
@@ -449,6 +477,8 @@ void runSimpleKernel(const Config &config, const Point &point, Input &input, Res
         // src is fully replicated on every node
         PointDistribution::collectPtsAll(srcSLCoordGlobal);
         PointDistribution::collectPtsAll(srcDLCoordGlobal);
+        shiftWall(srcSLCoordGlobal);
+        shiftWall(srcDLCoordGlobal);
 
         KERNEL kernel = data.first;
         auto &value = data.second;
@@ -471,7 +501,7 @@ void runSimpleKernel(const Config &config, const Point &point, Input &input, Res
 
         // Create mapping of kernels to 'true value' functions
         kernel_func kernelTestSL, kernelTestDL;
-        std::tie(kernelTestSL, kernelTestDL) = SL_kernels[kernel];
+        std::tie(kernelTestSL, kernelTestDL) = config.wall ? SL_wall_kernels[kernel] : SL_kernels[kernel];
 
         std::vector<double> trgLocal(nTrg * kdimTrg, 0);
         // check results
@@ -519,12 +549,13 @@ void runFMM(const Config &config, const int p, const Point &point, Input &input,
     const int k = (config.K == 0) ? ~((int)0) : config.K;
     const PAXIS paxis = static_cast<PAXIS>(config.pbc);
     const int maxPoints = config.maxPoints;
+    const PRECISION precision = config.singlePrecision ? PRECISION::FLOAT : PRECISION::DOUBLE;
 
     std::shared_ptr<STKFMM> fmmPtr;
     if (config.wall) {
-        fmmPtr = std::make_shared<StkWallFMM>(p, maxPoints, paxis, k);
+        fmmPtr = std::make_shared<StkWallFMM>(p, maxPoints, paxis, k, true, precision);
     } else {
-        fmmPtr = std::make_shared<Stk3DFMM>(p, maxPoints, paxis, k);
+        fmmPtr = std::make_shared<Stk3DFMM>(p, maxPoints, paxis, k, true, precision);
     }
     fmmPtr->showActiveKernels();
 
@@ -599,6 +630,79 @@ void runFMM(const Config &config, const int p, const Point &point, Input &input,
         result[kernel] = trgLocalValue;
         timing[kernel] = std::make_pair(treeTime, runTime);
     }
+
+    if (p <= 2)
+        return;
+    const int nSL = point.srcLocalSL.size() / 3;
+    const int nDL = point.srcLocalDL.size() / 3;
+    const int nTrg = point.trgLocal.size() / 3;
+    auto report = [&](const std::string &name, const std::vector<std::vector<double>> &values,
+                      const std::vector<std::vector<double>> &separate) {
+        double diff[2] = {0, 0}; // squared difference and norm
+        for (size_t k = 0; k < values.size(); k++) {
+            for (size_t i = 0; i < values[k].size(); i++) {
+                diff[0] += pow(values[k][i] - separate[k][i], 2);
+                diff[1] += pow(separate[k][i], 2);
+            }
+        }
+        MPI_Allreduce(MPI_IN_PLACE, diff, 2, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        printf_rank0("%s, relative L2 difference to separate FMMs %g\n", name.c_str(), sqrt(diff[0] / diff[1]));
+    };
+
+    // nBatchRHS + 1 value sets, one batch and one set alone. set r is the sources of the kernel times r + 1,
+    // except the RPY radius
+    for (const auto &it : batchKernelMap) {
+        const KERNEL kernel = it.first;
+        if (!result.count(kernel))
+            continue;
+        int kdimSL, kdimDL, kdimTrg;
+        std::tie(kdimSL, kdimDL, kdimTrg) = getKernelDimension(kernel);
+        const int nRHS = nBatchRHS + 1;
+        const auto &src = input[kernel];
+        const auto &trg = result[kernel];
+        std::vector<double> srcSL(nRHS * kdimSL * nSL), srcDL(nRHS * kdimDL * nDL);
+        std::vector<double> trgBatch(nRHS * kdimTrg * nTrg, 0.0), trgSeparate(nRHS * kdimTrg * nTrg);
+        for (int r = 0; r < nRHS; r++) {
+            for (int i = 0; i < nSL; i++)
+                for (int j = 0; j < kdimSL; j++)
+                    srcSL[(nRHS * i + r) * kdimSL + j] =
+                        (kernel == KERNEL::RPY && j == 3 ? 1 : r + 1) * src.srcLocalSL[kdimSL * i + j];
+            for (int i = 0; i < nDL; i++)
+                for (int j = 0; j < kdimDL; j++)
+                    srcDL[(nRHS * i + r) * kdimDL + j] = (r + 1) * src.srcLocalDL[kdimDL * i + j];
+            for (int i = 0; i < nTrg; i++)
+                for (int j = 0; j < kdimTrg; j++)
+                    trgSeparate[(nRHS * i + r) * kdimTrg + j] = (r + 1) * trg[kdimTrg * i + j];
+        }
+        fmmPtr->evaluateFMMBatch(kernel, nRHS, nSL, srcSL.data(), nTrg, trgBatch.data(), nDL,
+                                 kdimDL ? srcDL.data() : nullptr);
+        report("batched " + getKernelName(kernel), {trgBatch}, {trgSeparate});
+    }
+
+    // fused kernels in one traversal, compared to separate FMMs on the points of the last kernel
+    if (!config.wall) {
+        if (result.count(KERNEL::Stokes) && result.count(KERNEL::LapPGrad)) {
+            const auto &stk = input[KERNEL::Stokes];
+            const auto &lap = input[KERNEL::LapPGrad];
+            std::vector<double> trgStk(3 * nTrg, 0.0), trgLap(4 * nTrg, 0.0);
+            fmmPtr->evaluateFMM({KERNEL::Stokes, KERNEL::LapPGrad}, nSL,
+                                {stk.srcLocalSL.data(), lap.srcLocalSL.data()}, nTrg, {trgStk.data(), trgLap.data()},
+                                nDL, {nullptr, lap.srcLocalDL.data()});
+            report("fused Stokes + LapPGrad", {trgStk, trgLap}, {result[KERNEL::Stokes], result[KERNEL::LapPGrad]});
+        }
+
+        if (result.count(KERNEL::PVel) && result.count(KERNEL::Traction)) {
+            // both from the PVel sources
+            const auto &src = input[KERNEL::PVel];
+            std::vector<double> trgPVel(4 * nTrg, 0.0), trgTraction(9 * nTrg, 0.0), trgSeparate(9 * nTrg, 0.0);
+            fmmPtr->evaluateFMM({KERNEL::PVel, KERNEL::Traction}, nSL, {src.srcLocalSL.data(), src.srcLocalSL.data()},
+                                nTrg, {trgPVel.data(), trgTraction.data()}, nDL,
+                                {src.srcLocalDL.data(), src.srcLocalDL.data()});
+            fmmPtr->evaluateFMM({KERNEL::Traction}, nSL, {src.srcLocalSL.data()}, nTrg, {trgSeparate.data()}, nDL,
+                                {src.srcLocalDL.data()});
+            report("fused PVel + Traction", {trgPVel, trgTraction}, {result[KERNEL::PVel], trgSeparate});
+        }
+    }
 }
 
 void checkError(const int dim, const std::vector<double> &A, const std::vector<double> &B,
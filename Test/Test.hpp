@@ -33,7 +33,9 @@ struct Config {
     bool verify = true;
     bool convergence = true;
     bool wall = false;
+    bool noslip = true;
     bool dump = true;
+    bool singlePrecision = false;
 
     Config() = default;
     void parse(int argc, char **argv);
@@ -29,7 +29,7 @@ int main(int argc, char **argv) {
     printf_rank0("src value generated\n");
 
     if (config.verify) {
-        if (config.wall) {
+        if (config.wall && config.noslip) {
             // verify with zero on wall
             for (auto &k : input) {
                 auto kernel = k.first;
@@ -79,6 +79,8 @@ int main(int argc, char **argv) {
             }
 
             appendHistory(history, p, timing, pResult, verifyResult, convResult, transResult);
+            // operators of order p are not used again
+            stkfmm::STKFMM::releaseOperators();
         }
     }
 